@@ -1,7 +1,15 @@
+#include "llvm/Analysis/CaptureTracking.h"
+#include "llvm/Analysis/MemoryBuiltins.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
 
 using namespace llvm;
 
@@ -11,6 +19,14 @@ using FunIndex = std::set<std::pair<StringRef, StringRef>>;
 
 const StringRef nonatomic_attr = "ltest_nonatomic";
 
+// Only the DPOR strategy uses the reported accesses, the other strategies
+// don't pay for the calls of CoroAccess().
+static cl::opt<bool> report_accesses(
+    "ltest-report-accesses",
+    cl::desc("Report the memory accesses of the target methods and of the "
+             "functions they call, for the DPOR strategy"),
+    cl::init(false));
+
 FunIndex CreateFunIndex(const Module &M) {
   FunIndex index{};
   for (auto it = M.global_begin(); it != M.global_end(); ++it) {
@@ -36,19 +52,67 @@ bool HasAttribute(const FunIndex &index, const StringRef name,
   return index.find({attr, name}) != index.end();
 }
 
+using GetTLI = std::function<const TargetLibraryInfo &(Function &)>;
+
 struct YieldInserter {
-  YieldInserter(Module &M) : M(M) {
-    CoroYieldF = M.getOrInsertFunction(
-        "CoroYield", FunctionType::get(Type::getVoidTy(M.getContext()), {}));
+  // Kinds of the accesses, see ltest::AccessKind.
+  enum AccessKind { kRead = 0, kWrite = 1, kReadWrite = 2, kUnknown = 3 };
+
+  YieldInserter(Module &M, GetTLI get_tli)
+      : M(M), DL(M.getDataLayout()), get_tli(std::move(get_tli)) {
+    auto &ctx = M.getContext();
+    // The fast paths are defined in lib.h and are inlined into the target,
+    // they call CoroYield only when the task has to switch.
+    if (!report_accesses) {
+      auto fast = M.getFunction("CoroYieldFast");
+      CoroYieldF = M.getOrInsertFunction(
+          fast && !fast->isDeclaration() ? "CoroYieldFast" : "CoroYield",
+          FunctionType::get(Type::getVoidTy(ctx), {}));
+      return;
+    }
+    auto type = FunctionType::get(
+        Type::getVoidTy(ctx),
+        {PointerType::getUnqual(ctx), DL.getIntPtrType(ctx),
+         Type::getInt32Ty(ctx)},
+        false);
+    auto fast = M.getFunction("CoroYieldAccessFast");
+    CoroYieldF = M.getOrInsertFunction(fast && !fast->isDeclaration()
+                                           ? "CoroYieldAccessFast"
+                                           : "CoroYieldAccess",
+                                       type);
+    CoroAccessF = M.getOrInsertFunction("CoroAccess", type);
   }
 
   void Run(const FunIndex &index) {
+    // The functions the targets call are run in the steps of the targets, so
+    // their accesses are reported too, but without the yields.
+    std::vector<Function *> callees;
+    std::set<Function *> seen;
     for (auto &F : M) {
       if (IsTarget(F.getName(), index)) {
-        InsertYields(F, index);
+        seen.insert(&F);
+        callees.push_back(&F);
+      }
+    }
+    for (size_t i = 0; report_accesses && i < callees.size(); ++i) {
+      for (auto &I : instructions(*callees[i])) {
+        auto call = dyn_cast<CallBase>(&I);
+        auto fun = call ? call->getCalledFunction() : nullptr;
+        if (fun && !fun->isDeclaration() && !IsRuntime(fun) &&
+            seen.insert(fun).second) {
+          callees.push_back(fun);
+        }
+      }
+    }
 
-        errs() << "yields inserted to the " << F.getName() << "\n";
-        errs() << F << "\n";
+    for (auto F : callees) {
+      if (IsTarget(F->getName(), index)) {
+        InsertYields(*F, index);
+
+        errs() << "yields inserted to the " << F->getName() << "\n";
+        errs() << *F << "\n";
+      } else {
+        InsertAccesses(*F);
       }
     }
   }
@@ -58,25 +122,173 @@ struct YieldInserter {
     return HasAttribute(index, fun_name, nonatomic_attr);
   }
 
+  bool IsRuntime(Function *fun) {
+    auto name = fun->getName();
+    return name == CoroYieldF.getCallee()->getName() ||
+           (report_accesses && name == CoroAccessF.getCallee()->getName());
+  }
+
   bool NeedInterrupt(Instruction *insn, const FunIndex &index) {
     if (isa<LoadInst>(insn) || isa<StoreInst>(insn) ||
-         isa<AtomicRMWInst>(insn) /*||
+         isa<AtomicRMWInst>(insn) || isa<AtomicCmpXchgInst>(insn) /*||
         isa<InvokeInst>(insn)*/) {
       return true;
     }
     return false;
   }
 
+  struct Access {
+    Value *address;
+    Type *type;
+    AccessKind kind;
+  };
+
+  // Returns the address the instruction accesses, the type of the accessed
+  // value and the kind of the access.
+  Access GetAccess(Instruction *insn) {
+    if (auto load = dyn_cast<LoadInst>(insn)) {
+      return {load->getPointerOperand(), load->getType(), kRead};
+    }
+    if (auto store = dyn_cast<StoreInst>(insn)) {
+      return {store->getPointerOperand(), store->getValueOperand()->getType(),
+              kWrite};
+    }
+    if (auto rmw = dyn_cast<AtomicRMWInst>(insn)) {
+      return {rmw->getPointerOperand(), rmw->getValOperand()->getType(),
+              kReadWrite};
+    }
+    auto cas = cast<AtomicCmpXchgInst>(insn);
+    return {cas->getPointerOperand(), cas->getCompareOperand()->getType(),
+            kReadWrite};
+  }
+
+  // Returns the address to report, null if it's a local of the task that
+  // the other tasks can't see.
+  Value *GetReported(Value *address) {
+    auto object = getUnderlyingObject(address);
+    if (isa<AllocaInst>(object) &&
+        !PointerMayBeCaptured(object, /*ReturnCaptures=*/true,
+                              /*StoreCaptures=*/true)) {
+      return ConstantPointerNull::get(
+          PointerType::getUnqual(M.getContext()));
+    }
+    return address;
+  }
+
+  // Returns the arguments of the report of the access.
+  SmallVector<Value *, 3> ReportArgs(Builder &Builder, const Access &access) {
+    auto size = DL.getTypeStoreSize(access.type).getKnownMinValue();
+    return {GetReported(access.address),
+            ConstantInt::get(DL.getIntPtrType(M.getContext()), size),
+            Builder.getInt32(access.kind)};
+  }
+
+  void ReportAccess(Builder &Builder, Value *address, Value *size,
+                    AccessKind kind) {
+    address = GetReported(address);
+    if (isa<ConstantPointerNull>(address)) {
+      return;
+    }
+    size = Builder.CreateZExtOrTrunc(size, DL.getIntPtrType(M.getContext()));
+    Builder.CreateCall(CoroAccessF, {address, size, Builder.getInt32(kind)});
+  }
+
+  static bool IsFree(CallBase *call, const TargetLibraryInfo &TLI) {
+#if LLVM_VERSION_MAJOR >= 15
+    return getFreedOperand(call, &TLI) != nullptr;
+#else
+    return isFreeCall(call, &TLI) != nullptr;
+#endif
+  }
+
+  // Reports the accesses of the call of a function that isn't instrumented.
+  // The calls of the functions that may access any memory make the step
+  // unknown. The allocations are not reported, the memory of the allocator
+  // isn't seen by the targets.
+  void ReportCall(Builder &Builder, CallBase *call) {
+    auto fun = call->getCalledFunction();
+    if (fun && (!fun->isDeclaration() || IsRuntime(fun))) {
+      // The callee is instrumented, see Run().
+      return;
+    }
+    Builder.SetInsertPoint(call);
+    if (auto set = dyn_cast<MemSetInst>(call)) {
+      ReportAccess(Builder, set->getDest(), set->getLength(), kWrite);
+      return;
+    }
+    if (auto transfer = dyn_cast<MemTransferInst>(call)) {
+      ReportAccess(Builder, transfer->getSource(), transfer->getLength(),
+                   kRead);
+      ReportAccess(Builder, transfer->getDest(), transfer->getLength(),
+                   kWrite);
+      return;
+    }
+    auto &TLI = get_tli(*call->getFunction());
+    // The other intrinsics the frontend emits don't access memory the other
+    // tasks see (debug info, lifetime markers and so on).
+    if (isa<IntrinsicInst>(call) || call->doesNotAccessMemory() ||
+        isAllocationFn(call, &TLI) || IsFree(call, TLI)) {
+      return;
+    }
+    if (!call->onlyAccessesArgMemory()) {
+      auto &ctx = M.getContext();
+      Builder.CreateCall(CoroAccessF,
+                         {ConstantPointerNull::get(PointerType::getUnqual(ctx)),
+                          ConstantInt::get(DL.getIntPtrType(ctx), 0),
+                          Builder.getInt32(kUnknown)});
+      return;
+    }
+    // The callee may access any part of the objects of the arguments, so
+    // the size is unknown.
+    auto kind = call->onlyReadsMemory() ? kRead : kReadWrite;
+    for (auto &arg : call->args()) {
+      if (arg->getType()->isPointerTy()) {
+        ReportAccess(Builder, arg, Builder.getInt64(0), kind);
+      }
+    }
+  }
+
   void InsertYields(Function &F, const FunIndex &index) {
     Builder Builder(&*F.begin());
     for (auto &B : F) {
       for (auto it = B.begin(); std::next(it) != B.end(); ++it) {
+        if (auto call = dyn_cast<CallBase>(&*it); call && report_accesses) {
+          ReportCall(Builder, call);
+        }
         if (NeedInterrupt(&*it, index) && !ItsYieldInst(&*std::next(it))) {
+          auto access = GetAccess(&*it);
           Builder.SetInsertPoint(&*std::next(it));
-          Builder.CreateCall(CoroYieldF, {})->getIterator();
+          if (report_accesses) {
+            Builder.CreateCall(CoroYieldF, ReportArgs(Builder, access));
+          } else {
+            Builder.CreateCall(CoroYieldF, {});
+          }
           ++it;
         }
       }
+      // Invokes are terminators.
+      if (auto call = dyn_cast<CallBase>(B.getTerminator());
+          call && report_accesses) {
+        ReportCall(Builder, call);
+      }
+    }
+  }
+
+  // Reports the accesses of the function the targets call.
+  void InsertAccesses(Function &F) {
+    Builder Builder(&*F.begin());
+    std::vector<Instruction *> insns;
+    for (auto &I : instructions(F)) {
+      insns.push_back(&I);
+    }
+    for (auto insn : insns) {
+      if (auto call = dyn_cast<CallBase>(insn)) {
+        ReportCall(Builder, call);
+      } else if (NeedInterrupt(insn, {})) {
+        auto access = GetAccess(insn);
+        Builder.SetInsertPoint(insn);
+        Builder.CreateCall(CoroAccessF, ReportArgs(Builder, access));
+      }
     }
   }
 
@@ -93,7 +305,10 @@ struct YieldInserter {
   }
 
   Module &M;
+  const DataLayout &DL;
+  GetTLI get_tli;
   FunctionCallee CoroYieldF;
+  FunctionCallee CoroAccessF;
 };
 
 namespace {
@@ -102,7 +317,10 @@ struct YieldInsertPass final : public PassInfoMixin<YieldInsertPass> {
   PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM) {
     auto fun_index = CreateFunIndex(M);
 
-    YieldInserter gen{M};
+    auto &FAM = AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+    YieldInserter gen{M, [&FAM](Function &F) -> const TargetLibraryInfo & {
+                        return FAM.getResult<TargetLibraryAnalysis>(F);
+                      }};
     gen.Run(fun_index);
 
     return PreservedAnalyses::none();
@@ -0,0 +1,147 @@
+#include "include/coro_context.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+// Implemented in coro_context_asm.S.
+extern "C" {
+// Pushes callee-saved registers, stores the stack pointer to *from_sp,
+// switches to to_sp and pops the registers saved there.
+void ltest_switch_context(void** from_sp, void* to_sp);
+// First frame of a new context: calls fn(self), both are taken from the
+// callee-saved registers set up by CoroContext::Start().
+void ltest_context_trampoline();
+}
+
+namespace ltest {
+
+namespace {
+
+#if defined(__x86_64__)
+// rbp, rbx, r12-r15 and the return address.
+constexpr size_t kFrameSlots = 7;
+// Indices of the slots, counting from the saved stack pointer.
+constexpr size_t kSelfSlot = 4;    // rbx
+constexpr size_t kFnSlot = 3;      // r12
+constexpr size_t kReturnSlot = 6;  // return address
+// Keeps the stack 16-byte aligned at the call in the trampoline.
+constexpr size_t kTopPadding = 16;
+#elif defined(__aarch64__)
+// d8-d15, x19-x28, x29 and x30.
+constexpr size_t kFrameSlots = 20;
+constexpr size_t kSelfSlot = 8;     // x19
+constexpr size_t kFnSlot = 9;       // x20
+constexpr size_t kReturnSlot = 19;  // x30
+constexpr size_t kTopPadding = 0;
+#else
+#error "asm context backend supports only x86-64 and aarch64"
+#endif
+
+// Lays out the first frame of a context at the top of the stack, so the
+// first switch to it calls fn(self) from the trampoline.
+// Returns the stack pointer of the context.
+void* MakeFrame(void* stack_top, void* self, void (*fn)(CoroContext*)) {
+  auto top = reinterpret_cast<uintptr_t>(stack_top) & ~uintptr_t{15};
+  auto frame = reinterpret_cast<void**>(top - kTopPadding) - kFrameSlots;
+  std::memset(frame, 0, kFrameSlots * sizeof(void*));
+  frame[kSelfSlot] = self;
+  frame[kFnSlot] = reinterpret_cast<void*>(fn);
+  frame[kReturnSlot] = reinterpret_cast<void*>(&ltest_context_trampoline);
+  return frame;
+}
+
+// The stack all contexts of the thread run on in the shared stack mode.
+thread_local StackContext shared_stack{};
+thread_local bool shared_stack_enabled{};
+// The context whose frames are on the shared stack now, its used part is
+// saved lazily when another context is resumed.
+thread_local CoroContext* shared_stack_owner{};
+
+}  // namespace
+
+void CoroContext::SetSharedStack(bool enabled) {
+  assert(shared_stack_owner == nullptr);
+  if (enabled && shared_stack.sp == nullptr) {
+    shared_stack = GetStackPool().Allocate();
+  } else if (!enabled && shared_stack.sp != nullptr) {
+    GetStackPool().Deallocate(shared_stack);
+    shared_stack = StackContext{};
+  }
+  shared_stack_enabled = enabled;
+}
+
+void CoroContext::Start(Entry entry, void* arg) {
+  assert(!is_active);
+  this->entry = entry;
+  this->arg = arg;
+  on_shared_stack = shared_stack_enabled;
+  if (on_shared_stack) {
+    // The frame is laid out by Resume(), when the shared stack is ours.
+    sp = nullptr;
+  } else {
+    stack = GetStackPool().Allocate();
+    sp = MakeFrame(stack.sp, this, &CoroContext::Main);
+  }
+  is_active = true;
+}
+
+void CoroContext::Resume() {
+  assert(is_active);
+  if (on_shared_stack && shared_stack_owner != this) {
+    if (shared_stack_owner != nullptr) {
+      shared_stack_owner->SaveSharedStack();
+    }
+    shared_stack_owner = this;
+    if (sp == nullptr) {
+      sp = MakeFrame(shared_stack.sp, this, &CoroContext::Main);
+    } else {
+      RestoreSharedStack();
+    }
+  }
+  ltest_switch_context(&caller_sp, sp);
+  if (!is_active) {
+    if (on_shared_stack) {
+      shared_stack_owner = nullptr;
+    } else {
+      GetStackPool().Deallocate(stack);
+      stack = StackContext{};
+    }
+  }
+}
+
+void CoroContext::SaveSharedStack() {
+  // Only the part between the saved stack pointer and the top is used.
+  saved.assign(static_cast<char*>(sp), static_cast<char*>(shared_stack.sp));
+}
+
+void CoroContext::RestoreSharedStack() {
+  std::memcpy(static_cast<char*>(shared_stack.sp) - saved.size(),
+              saved.data(), saved.size());
+}
+
+void CoroContext::Suspend() { ltest_switch_context(&sp, caller_sp); }
+
+bool CoroContext::IsActive() const { return is_active; }
+
+void CoroContext::Main(CoroContext* self) {
+  self->entry(self->arg);
+  self->is_active = false;
+  // Never comes back, the stack is released by Resume().
+  ltest_switch_context(&self->sp, self->caller_sp);
+  __builtin_unreachable();
+}
+
+// The stack of the context that is not returned is not unwound, objects that
+// live on it are leaked.
+CoroContext::~CoroContext() {
+  if (shared_stack_owner == this) {
+    shared_stack_owner = nullptr;
+  }
+  if (stack.sp != nullptr) {
+    GetStackPool().Deallocate(stack);
+  }
+}
+
+}  // namespace ltest
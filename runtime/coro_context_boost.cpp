@@ -0,0 +1,63 @@
+#include "include/coro_context.h"
+
+#include <cassert>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+namespace ltest {
+
+namespace {
+
+// Implements the boost StackAllocator concept on top of the task stack pool.
+struct PooledStackAllocator {
+  boost::context::stack_context allocate() {  // NOLINT
+    auto stack = GetStackPool().Allocate();
+    boost::context::stack_context sctx;
+    sctx.sp = stack.sp;
+    sctx.size = stack.size;
+    return sctx;
+  }
+
+  void deallocate(boost::context::stack_context& sctx) noexcept {  // NOLINT
+    StackContext stack{sctx.sp, sctx.size};
+    GetStackPool().Deallocate(stack);
+  }
+};
+
+}  // namespace
+
+void CoroContext::Start(Entry entry, void* arg) {
+  assert(!fiber);
+  fiber = boost::context::fiber_context(
+      std::allocator_arg, PooledStackAllocator{},
+      [this, entry, arg](boost::context::fiber_context&& ctx) {
+        caller = std::move(ctx);
+        entry(arg);
+        return std::move(caller);
+      });
+}
+
+void CoroContext::Resume() {
+  assert(fiber);
+  fiber = std::move(fiber).resume();
+}
+
+void CoroContext::Suspend() {
+  assert(caller);
+  caller = std::move(caller).resume();
+}
+
+bool CoroContext::IsActive() const { return static_cast<bool>(fiber); }
+
+void CoroContext::SetSharedStack(bool enabled) {
+  if (enabled) {
+    throw std::invalid_argument{
+        "shared stack is supported only by the asm context backend"};
+  }
+}
+
+// Destroying the fiber that is not returned unwinds its stack.
+CoroContext::~CoroContext() = default;
+
+}  // namespace ltest
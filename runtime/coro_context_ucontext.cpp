@@ -0,0 +1,70 @@
+#include "include/coro_context.h"
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace ltest {
+
+void CoroContext::Start(Entry entry, void* arg) {
+  assert(!is_active);
+  stack = GetStackPool().Allocate();
+  this->entry = entry;
+  this->arg = arg;
+
+  if (getcontext(&uctx) != 0) {
+    std::abort();
+  }
+  uctx.uc_stack.ss_sp = static_cast<char*>(stack.sp) - stack.size;
+  uctx.uc_stack.ss_size = stack.size;
+  // Returning from the entry switches back to the caller of Resume().
+  uctx.uc_link = &caller;
+  // makecontext() passes only int arguments.
+  auto self = reinterpret_cast<uintptr_t>(this);
+  makecontext(&uctx,
+              reinterpret_cast<void (*)()>(&CoroContext::Trampoline), 2,
+              static_cast<unsigned int>(self >> 32),
+              static_cast<unsigned int>(self));
+  is_active = true;
+}
+
+void CoroContext::Resume() {
+  assert(is_active);
+  swapcontext(&caller, &uctx);
+  if (!is_active) {
+    GetStackPool().Deallocate(stack);
+    stack = StackContext{};
+  }
+}
+
+void CoroContext::Suspend() { swapcontext(&uctx, &caller); }
+
+bool CoroContext::IsActive() const { return is_active; }
+
+void CoroContext::SetSharedStack(bool enabled) {
+  if (enabled) {
+    throw std::invalid_argument{
+        "shared stack is supported only by the asm context backend"};
+  }
+}
+
+void CoroContext::Trampoline(unsigned int hi, unsigned int lo) {
+  auto self = (static_cast<uintptr_t>(hi) << 32) | lo;
+  Main(reinterpret_cast<CoroContext*>(self));
+}
+
+void CoroContext::Main(CoroContext* self) {
+  self->entry(self->arg);
+  self->is_active = false;
+}
+
+// The stack of the context that is not returned is not unwound, objects that
+// live on it are leaked.
+CoroContext::~CoroContext() {
+  if (stack.sp != nullptr) {
+    GetStackPool().Deallocate(stack);
+  }
+}
+
+}  // namespace ltest
@@ -0,0 +1,183 @@
+#include "include/dpor_trace.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <utility>
+
+namespace ltest {
+
+bool DporStep::ConflictsWith(const DporStep& other) const {
+  return (is_history && other.is_history) ||
+         accesses.ConflictsWith(other.accesses);
+}
+
+void DporStep::Merge(const DporStep& other) {
+  accesses.Merge(other.accesses);
+  is_history = is_history || other.is_history;
+}
+
+bool DporTrace::Push(std::vector<bool> enabled) {
+  assert(enabled.size() == threads_count);
+  State state;
+  state.enabled = std::move(enabled);
+  state.backtrack.resize(threads_count);
+  state.done.resize(threads_count);
+  if (!states.empty()) {
+    auto& parent = states.back();
+    for (auto& s : parent.sleep) {
+      if (!s.step.ConflictsWith(parent.step)) {
+        state.sleep.push_back(s);
+      }
+    }
+  }
+  states.push_back(std::move(state));
+  size_t last = states.size() - 1;
+  for (size_t i = 0; i < threads_count; ++i) {
+    if (states[last].enabled[i] && !IsAsleep(last, i)) {
+      states[last].backtrack[i] = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::optional<size_t> DporTrace::NextThread() {
+  size_t last = states.size() - 1;
+  auto& state = states[last];
+  for (size_t i = 0; i < threads_count; ++i) {
+    if (state.backtrack[i] && !state.done[i] && state.enabled[i] &&
+        !IsAsleep(last, i)) {
+      state.done[i] = true;
+      return i;
+    }
+  }
+  return std::nullopt;
+}
+
+void DporTrace::Take(size_t thread, DporStep step) {
+  auto& state = states.back();
+  state.thread = thread;
+  state.step = std::move(step);
+  DetectRaces(states.size() - 1);
+}
+
+void DporTrace::Sleep(size_t thread, DporStep step) {
+  states.back().sleep.push_back(Sleeper{thread, std::move(step)});
+}
+
+bool DporTrace::IsAsleep(size_t state, size_t thread) const {
+  auto& sleep = states[state].sleep;
+  return std::any_of(sleep.begin(), sleep.end(), [thread](const Sleeper& s) {
+    return s.thread == thread;
+  });
+}
+
+void DporTrace::DetectRaces(size_t last) {
+  auto& state = states[last];
+  size_t thread = state.thread;
+  std::vector<size_t> clock(threads_count);
+  for (size_t i = last; i-- > 0;) {
+    if (states[i].thread == thread) {
+      clock = states[i].clock;
+      break;
+    }
+  }
+  // Steps happen before the later ones only, so going backwards the clock
+  // has all the steps after i the last one depends on.
+  std::vector<size_t> races;
+  for (size_t i = last; i-- > 0;) {
+    auto& other = states[i];
+    if (other.thread == thread || !other.step.ConflictsWith(state.step)) {
+      continue;
+    }
+    if (clock[other.thread] <= i) {
+      races.push_back(i);
+    }
+    for (size_t t = 0; t < threads_count; ++t) {
+      clock[t] = std::max(clock[t], other.clock[t]);
+    }
+  }
+  clock[thread] = last + 1;
+  state.clock = std::move(clock);
+  for (auto race : races) {
+    ReverseRace(race, last);
+  }
+}
+
+// The race is reversed by the steps after `first` that don't depend on it,
+// followed by the step `second`; a thread can start them if its first step
+// among them doesn't depend on an earlier one (initials of the sequence).
+void DporTrace::ReverseRace(size_t first, size_t second) {
+  constexpr size_t kNone = std::numeric_limits<size_t>::max();
+  // First step of each thread in the sequence.
+  std::vector<size_t> firsts(threads_count, kNone);
+  for (size_t j = first + 1; j < second; ++j) {
+    auto t = states[j].thread;
+    if (firsts[t] == kNone && !HappensBefore(first, j)) {
+      firsts[t] = j;
+    }
+  }
+  if (firsts[states[second].thread] == kNone) {
+    firsts[states[second].thread] = second;
+  }
+  auto& state = states[first];
+  std::optional<size_t> initial;
+  for (size_t q = 0; q < threads_count; ++q) {
+    auto j = firsts[q];
+    if (j == kNone) {
+      continue;
+    }
+    // The steps of a thread happen before its later steps, so the first
+    // step of the thread in the sequence is enough to check.
+    bool is_initial = true;
+    for (size_t t = 0; t < threads_count && is_initial; ++t) {
+      is_initial = t == q || firsts[t] >= j || !HappensBefore(firsts[t], j);
+    }
+    if (!is_initial) {
+      continue;
+    }
+    if (state.backtrack[q]) {
+      return;
+    }
+    if (!initial.has_value() || q == states[second].thread) {
+      initial = q;
+    }
+  }
+  if (initial.has_value() && state.enabled[*initial]) {
+    state.backtrack[*initial] = true;
+    return;
+  }
+  // The verifier has disabled the thread, so any enabled one may start
+  // the reversed race.
+  for (size_t q = 0; q < threads_count; ++q) {
+    state.backtrack[q] = state.backtrack[q] || state.enabled[q];
+  }
+}
+
+void DporTrace::ReversePendingStarts(const std::vector<bool>& can_start) {
+  size_t last = states.size() - 1;
+  for (size_t q = 0; q < threads_count; ++q) {
+    if (!can_start[q]) {
+      continue;
+    }
+    // Clock of the last step of the thread, its start would follow it.
+    std::vector<size_t> clock(threads_count);
+    for (size_t i = last + 1; i-- > 0;) {
+      if (states[i].thread == q) {
+        clock = states[i].clock;
+        break;
+      }
+    }
+    for (size_t i = last + 1; i-- > 0;) {
+      auto& state = states[i];
+      if (state.thread != q && state.step.is_history &&
+          clock[state.thread] <= i && state.enabled[q]) {
+        state.backtrack[q] = true;
+        break;
+      }
+    }
+  }
+}
+
+}  // namespace ltest
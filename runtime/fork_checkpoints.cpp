@@ -0,0 +1,73 @@
+#include "include/fork_checkpoints.h"
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <iostream>
+#include <system_error>
+
+namespace ltest {
+
+ForkCheckpoints::ForkCheckpoints(size_t depth, size_t stride)
+    : depth(depth), stride(stride) {
+  if (depth == 0) {
+    return;
+  }
+  void* vp = ::mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (vp == MAP_FAILED) {
+    throw std::system_error(errno, std::generic_category(), "mmap");
+  }
+  shared = static_cast<Shared*>(vp);
+}
+
+ForkCheckpoints::~ForkCheckpoints() {
+  if (shared != nullptr) {
+    ::munmap(shared, sizeof(Shared));
+  }
+}
+
+bool ForkCheckpoints::Fork() {
+  // Otherwise the buffered output is printed by both processes.
+  std::cout.flush();
+  std::fflush(nullptr);
+  child = ::fork();
+  if (child == -1) {
+    throw std::system_error(errno, std::generic_category(), "fork");
+  }
+  return child == 0;
+}
+
+size_t ForkCheckpoints::Wait() {
+  int status;
+  while (::waitpid(child, &status, 0) == -1) {
+    if (errno != EINTR) {
+      throw std::system_error(errno, std::generic_category(), "waitpid");
+    }
+  }
+  child = -1;
+  if (WIFSIGNALED(status)) {
+    std::signal(WTERMSIG(status), SIG_DFL);
+    std::raise(WTERMSIG(status));
+    ::_exit(128 + WTERMSIG(status));
+  }
+  if (shared->taken_over || WEXITSTATUS(status) != 0) {
+    ::_exit(WEXITSTATUS(status));
+  }
+  return shared->finished_rounds;
+}
+
+void ForkCheckpoints::ExitChild(size_t finished_rounds) {
+  shared->finished_rounds = finished_rounds;
+  std::cout.flush();
+  std::fflush(nullptr);
+  ::_exit(0);
+}
+
+void ForkCheckpoints::TakeOver() { shared->taken_over = true; }
+
+}  // namespace ltest
@@ -4,14 +4,17 @@ namespace ltest {
 
 namespace generators {
 
-std::shared_ptr<Token> generated_token{};
+int randomInt(int from, int to) {
+  return std::uniform_int_distribution<int>(from, to)(GetRuntimeContext().rng);
+}
 
 // Generates empty arguments.
-std::tuple<> genEmpty(size_t thread_num) { return std::tuple<>(); }
+std::tuple<> genEmpty() { return std::tuple<>(); }
 
 // Generates runtime token.
 // Can be called only once per task creation.
-std::tuple<std::shared_ptr<Token>> genToken(size_t thread_num) {
+std::tuple<std::shared_ptr<Token>> genToken() {
+  auto& generated_token = GetRuntimeContext().generated_token;
   assert(!generated_token && "forgot to reset generated_token");
   generated_token = std::make_shared<Token>();
   return {generated_token};
@@ -0,0 +1,102 @@
+#pragma once
+#include <cstddef>
+
+#if defined(LTEST_CONTEXT_ASM)
+#include <vector>
+#elif defined(LTEST_CONTEXT_UCONTEXT)
+#include <ucontext.h>
+#else
+#include <boost/context/fiber_fcontext.hpp>
+#endif
+
+#include "stack_pool.h"
+
+namespace ltest {
+
+// CoroContext is an execution context with its own stack from the stack pool,
+// tasks run on top of it. The backend is chosen at build time, see
+// LTEST_CONTEXT_BACKEND in runtime/CMakeLists.txt:
+//  * boost: Boost.Context fibers, the default one;
+//  * asm: hand-written switcher that saves only callee-saved registers,
+//    see coro_context_asm.S;
+//  * ucontext: getcontext/swapcontext, slow, but it is understood by
+//    debuggers and sanitizers.
+class CoroContext {
+ public:
+  using Entry = void (*)(void* arg);
+
+  CoroContext() = default;
+  CoroContext(const CoroContext&) = delete;
+  CoroContext& operator=(const CoroContext&) = delete;
+
+  // Prepares the context to run entry(arg).
+  // The context must not be active.
+  void Start(Entry entry, void* arg);
+
+  // Switches into the context.
+  // Returns when the context suspends or its entry returns, in the latter
+  // case the stack goes back to the pool.
+  void Resume();
+
+  // Switches back to the caller of Resume().
+  // Must be called from the context itself.
+  void Suspend();
+
+  // Checks if the context was started and its entry is not returned yet.
+  bool IsActive() const;
+
+  // Makes the contexts started after the call run on one shared stack, like
+  // libco does. When another context is resumed, the used part of the shared
+  // stack is copied to the context that owns it and copied back on its next
+  // Resume(), so the memory is proportional to the depth of the stacks
+  // rather than to the number of contexts.
+  // Pointers to the objects on the stack of a suspended context are invalid,
+  // so tasks must not share them (e.g. wait on a futex word on the stack).
+  // The mode is set per thread.
+  // Only the asm backend supports it, the others throw std::invalid_argument.
+  static void SetSharedStack(bool enabled);
+
+#if defined(LTEST_CONTEXT_ASM)
+  static constexpr bool kSupportsSharedStack = true;
+#else
+  static constexpr bool kSupportsSharedStack = false;
+#endif
+
+  // Destroying the active context unwinds its stack only with the boost
+  // backend, the others drop the stack without running the destructors of
+  // the objects on it.
+  ~CoroContext();
+
+ private:
+#if defined(LTEST_CONTEXT_ASM) || defined(LTEST_CONTEXT_UCONTEXT)
+  static void Main(CoroContext* self);
+
+  Entry entry{};
+  void* arg{};
+  StackContext stack{};
+  bool is_active{};
+#endif
+
+#if defined(LTEST_CONTEXT_ASM)
+  void SaveSharedStack();
+  void RestoreSharedStack();
+
+  // Saved stack pointers, the registers themselves are saved on the stacks.
+  void* sp{};
+  void* caller_sp{};
+  // Is true if the context was started in the shared stack mode.
+  bool on_shared_stack{};
+  // Used part of the shared stack while another context owns it.
+  std::vector<char> saved;
+#elif defined(LTEST_CONTEXT_UCONTEXT)
+  static void Trampoline(unsigned int hi, unsigned int lo);
+
+  ucontext_t uctx;
+  ucontext_t caller;
+#else
+  boost::context::fiber_context fiber;
+  boost::context::fiber_context caller;
+#endif
+};
+
+}  // namespace ltest
@@ -0,0 +1,375 @@
+#pragma once
+#include <cassert>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "dpor_trace.h"
+#include "lib.h"
+#include "lincheck.h"
+#include "logger.h"
+#include "pretty_print.h"
+#include "scheduler.h"
+#include "stable_vector.h"
+#include "task_terminator.h"
+
+// DporScheduler explores the executions TLAScheduler does, without the limit
+// of the switches, but only one execution of each class of the executions
+// that differ in the order of the steps that commute. It's the dynamic
+// partial order reduction with source sets and sleep sets (Abdulla et al.,
+// "Optimal dynamic partial order reduction", POPL 2014): when a step races
+// with an earlier one of another thread, a thread that reverses the race is
+// added to the backtrack set of the state before the earlier step.
+//
+// Two steps commute unless their accesses overlap and one of them writes,
+// see ltest::StepAccesses. The accesses are reported by YieldPass with
+// -ltest-report-accesses, so the steps of the targets built without it
+// commute with nothing and every execution is explored. The races and the backtrack and sleep sets are kept by
+// ltest::DporTrace, the scheduler runs the tasks.
+template <typename TargetObj, StrategyVerifier Verifier>
+struct DporScheduler : Scheduler {
+  DporScheduler(size_t max_tasks, size_t max_rounds, size_t threads_count,
+                size_t max_depth, std::vector<TaskBuilder> constructors,
+                ModelChecker& checker, PrettyPrinter& pretty_printer,
+                std::function<void()> cancel_func, uint64_t seed = 0)
+      : pretty_printer{pretty_printer},
+        max_tasks{max_tasks},
+        max_rounds{max_rounds},
+        max_depth{max_depth},
+        constructors{std::move(constructors)},
+        checker{checker},
+        trace{threads_count},
+        cancel(cancel_func),
+        seed(seed) {
+    for (size_t i = 0; i < threads_count; ++i) {
+      threads.emplace_back(Thread{
+          .id = i,
+          .tasks = StableVector<Task>{},
+      });
+    }
+  }
+
+  Scheduler::Result Run() override {
+    // All rounds share the prefixes, so the arguments are generated by one
+    // sequence, the first round seeds it.
+    ltest::GetRuntimeContext().StartRound(0, ltest::GetRoundSeed(seed, 0));
+    auto [_, res] = Explore();
+    std::cout << "dpor: rounds = " << finished_rounds
+              << ", sleep blocked = " << blocked_rounds << "\n";
+    return res;
+  }
+
+  ~DporScheduler() { TerminateTasks(); }
+
+ private:
+  struct Thread {
+    size_t id;
+    StableVector<Task> tasks;
+  };
+
+  // Frame is the choice made from a state of ltest::DporTrace, the frames
+  // are explored depth-first as in TLAScheduler.
+  struct Frame {
+    // The choice: the thread, and the constructor if the task is new.
+    Task* task{};
+    bool is_new{};
+    size_t thread{};
+    size_t constructor{};
+    // Is true while the branch of the choice is explored.
+    bool in_branch{};
+    // Is true if the next constructor of the thread is chosen already.
+    bool has_next_constructor{};
+    // Steps of all the constructors of the thread taken so far.
+    std::optional<ltest::DporStep> thread_step;
+    // Undo record of the choice.
+    bool is_finished{};
+    size_t full_history_size{};
+    ltest::TaskArena::Mark arena_mark{};
+  };
+
+  // Terminates all running tasks, see ltest::TaskTerminator.
+  // cancel() func takes care for graceful shutdown
+  void TerminateTasks() {
+    cancel();
+    for (size_t i = 0; i < threads.size(); ++i) {
+      terminator.AddThread(threads[i].tasks);
+    }
+    terminator.Terminate([this] {
+      ltest::ResetTarget(state, state_in_round_heap, false);
+    });
+  }
+
+  // Replays all actions from 0 to the step_end.
+  void Replay(size_t step_end) {
+    TerminateTasks();
+    ltest::ResetTarget(state, state_in_round_heap, true);
+    for (size_t step = 0; step < step_end; ++step) {
+      auto& frame = frames[step];
+      auto task = frame.task;
+      assert(task);
+      if (frame.is_new) {
+        *task = (*task)->Restart(&state);
+      }
+      (*task)->Resume();
+    }
+    ltest::GetRuntimeContext().coroutine_status.reset();
+  }
+
+  void UpdateFullHistory(size_t thread_id, Task& task, bool is_new) {
+    auto& coroutine_status = ltest::GetRuntimeContext().coroutine_status;
+    if (coroutine_status.has_value()) {
+      if (is_new) {
+        assert(coroutine_status->has_started);
+        full_history.emplace_back(thread_id, task);
+      }
+      verifier.UpdateState(coroutine_status->name, thread_id,
+                           coroutine_status->has_started);
+      full_history.emplace_back(thread_id, coroutine_status.value());
+      coroutine_status.reset();
+    } else {
+      verifier.UpdateState(task->GetName(), thread_id, is_new);
+      full_history.emplace_back(thread_id, task);
+    }
+  }
+
+  // Checks if the thread can make a step in the current state: resume its
+  // task, or create a new one.
+  bool IsEnabled(size_t thread) {
+    auto& tasks = threads[thread].tasks;
+    if (!tasks.empty() && !tasks.back()->IsReturned()) {
+      return !tasks.back()->IsParked() && !tasks.back()->IsBlocked() &&
+             verifier.Verify(CreatedTaskMetaData{tasks.back()->GetMethodId(),
+                                                 false, thread});
+    }
+    return FindConstructor(thread, 0).has_value();
+  }
+
+  // Returns the first constructor from `from` the thread can create a task
+  // of.
+  std::optional<size_t> FindConstructor(size_t thread, size_t from) {
+    if (started_tasks == max_tasks ||
+        threads[thread].tasks.size() >= max_depth) {
+      return std::nullopt;
+    }
+    for (size_t i = from; i < constructors.size(); ++i) {
+      if (verifier.Verify(CreatedTaskMetaData{constructors[i].GetMethodId(),
+                                              true, thread})) {
+        return i;
+      }
+    }
+    return std::nullopt;
+  }
+
+  // Pushes the frame of the current state.
+  void PushFrame() {
+    size_t threads_count = threads.size();
+    std::vector<bool> enabled(threads_count);
+    bool all_parked = true;
+    for (size_t i = 0; i < threads_count; ++i) {
+      auto& tasks = threads[i].tasks;
+      if (tasks.empty() || tasks.back()->IsReturned() ||
+          (!tasks.back()->IsParked() && !tasks.back()->IsBlocked())) {
+        all_parked = false;
+      }
+      enabled[i] = IsEnabled(i);
+    }
+    assert(!all_parked && "deadlock");
+    if (!trace.Push(std::move(enabled))) {
+      ++blocked_rounds;
+    }
+    frames.push_back(Frame{});
+  }
+
+  // Moves the frame to its next choice, returns false if there are no more.
+  // The next constructor of the thread of the last choice goes first, then
+  // the threads of the backtrack set that are not taken yet.
+  bool NextChoice(Frame& frame) {
+    if (frame.has_next_constructor) {
+      frame.has_next_constructor = false;
+      return true;
+    }
+    while (auto thread = trace.NextThread()) {
+      frame.thread = *thread;
+      frame.thread_step.reset();
+      auto& tasks = threads[*thread].tasks;
+      if (!tasks.empty() && !tasks.back()->IsReturned()) {
+        frame.is_new = false;
+        return true;
+      }
+      auto constructor = FindConstructor(*thread, 0);
+      if (constructor.has_value()) {
+        frame.is_new = true;
+        frame.constructor = *constructor;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Makes the choice of the frame: creates the task if it's new and resumes
+  // it, recording the accesses of the step.
+  void MakeChoice(Frame& frame) {
+    auto& thread = threads[frame.thread];
+    auto thread_id = thread.id;
+    auto& tasks = thread.tasks;
+    if (frame.is_new) {
+      frame.arena_mark = arena.GetMark();
+      tasks.emplace_back(constructors[frame.constructor].Build(
+          arena, &state, thread_id, -1));
+      started_tasks++;
+    }
+    auto& task = tasks.back();
+    frame.task = &task;
+    frame.full_history_size = full_history.size();
+    if (frame.is_new) {
+      sequential_history.emplace_back(Invoke(task, thread_id));
+    }
+
+    assert(!task->IsParked() && !task->IsBlocked());
+    ltest::DporStep step;
+    ltest_step_accesses = &step.accesses;
+    task->Resume();
+    ltest_step_accesses = nullptr;
+    UpdateFullHistory(thread_id, task, frame.is_new);
+    frame.is_finished = task->IsReturned();
+    if (frame.is_finished) {
+      finished_tasks++;
+      verifier.OnFinished(TaskWithMetaData{task, false, thread_id});
+      auto result = task->GetRetVal();
+      sequential_history.emplace_back(Response(task, result, thread_id));
+    }
+    step.is_history = frame.is_new || frame.is_finished;
+    if (frame.thread_step.has_value()) {
+      frame.thread_step->Merge(step);
+    } else {
+      frame.thread_step = step;
+    }
+    trace.Take(frame.thread, std::move(step));
+  }
+
+  // See ltest::DporTrace::ReversePendingStarts().
+  void ReversePendingStarts() {
+    std::vector<bool> can_start(threads.size());
+    for (size_t q = 0; q < threads.size(); ++q) {
+      auto& tasks = threads[q].tasks;
+      can_start[q] = tasks.size() < max_depth &&
+                     (tasks.empty() || tasks.back()->IsReturned());
+    }
+    trace.ReversePendingStarts(can_start);
+  }
+
+  // Undoes the histories and the counters of the choice of the frame.
+  void UndoChoice(Frame& frame) {
+    full_history.erase(full_history.begin() + frame.full_history_size,
+                       full_history.end());
+    if (frame.is_finished) {
+      --finished_tasks;
+      sequential_history.pop_back();
+    }
+    if (frame.is_new) {
+      --started_tasks;
+      sequential_history.pop_back();
+    }
+  }
+
+  // Returns to the state of the step after the branch of its choice. When
+  // the thread has no more constructors to try, it falls asleep.
+  void FinishBranch(Frame& frame, size_t step) {
+    UndoChoice(frame);
+    Replay(step);
+    if (frame.is_new) {
+      threads[frame.thread].tasks.pop_back();
+      arena.Rewind(frame.arena_mark);
+      auto constructor = FindConstructor(frame.thread, frame.constructor + 1);
+      if (constructor.has_value()) {
+        frame.constructor = *constructor;
+        frame.has_next_constructor = true;
+        return;
+      }
+    }
+    trace.Sleep(frame.thread, *frame.thread_step);
+  }
+
+  // Checks the round that has finished max_tasks. Returns true if it was the
+  // last round.
+  std::tuple<bool, typename Scheduler::Result> FinishRound() {
+    log() << "run round: " << finished_rounds << "\n";
+    if (log().verbose) {
+      pretty_printer.PrettyPrint(full_history, log());
+    }
+    log() << "===============================================\n\n";
+    log().flush();
+    ++finished_rounds;
+    if (!checker.Check(sequential_history)) {
+      return {false,
+              std::make_pair(Scheduler::FullHistory{}, sequential_history)};
+    }
+    return {finished_rounds == max_rounds, {}};
+  }
+
+  // Explores the executions depth-first like TLAScheduler::Explore(), the
+  // races found by the steps add the choices to the frames below.
+  std::tuple<bool, typename Scheduler::Result> Explore() {
+    frames.clear();
+    trace.Clear();
+    PushFrame();
+    while (!frames.empty()) {
+      size_t step = frames.size() - 1;
+      auto& frame = frames.back();
+      if (frame.in_branch) {
+        frame.in_branch = false;
+        FinishBranch(frame, step);
+      }
+      if (!NextChoice(frame)) {
+        frames.pop_back();
+        trace.Pop();
+        continue;
+      }
+      MakeChoice(frame);
+      frame.in_branch = true;
+
+      if (finished_tasks != max_tasks) {
+        PushFrame();
+        continue;
+      }
+      ReversePendingStarts();
+      auto [is_over, res] = FinishRound();
+      if (is_over || res.has_value()) {
+        return {is_over, res};
+      }
+    }
+    return {false, {}};
+  }
+
+  PrettyPrinter& pretty_printer;
+  size_t max_tasks;
+  size_t max_rounds;
+  size_t max_depth;
+
+  std::vector<TaskBuilder> constructors;
+  ModelChecker& checker;
+
+  // Running state.
+  size_t started_tasks{};
+  size_t finished_tasks{};
+  size_t finished_rounds{};
+  // Number of the branches cut by the sleep sets.
+  size_t blocked_rounds{};
+  TargetObj state{};
+  // Is the state created in the round heap, see ltest::ResetTarget().
+  bool state_in_round_heap{};
+  std::vector<std::variant<Invoke, Response>> sequential_history;
+  FullHistoryWithThreads full_history;
+  // Memory of the tasks.
+  ltest::TaskArena arena;
+  StableVector<Thread> threads;
+  std::vector<Frame> frames;
+  ltest::DporTrace trace;
+  Verifier verifier;
+  std::function<void()> cancel;
+  ltest::TaskTerminator terminator;
+  uint64_t seed;
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+#include "lib.h"
+
+namespace ltest {
+
+// DporStep is what the dependency of the steps is decided by.
+struct DporStep {
+  StepAccesses accesses;
+  // Does the step start or finish a task.
+  bool is_history{};
+
+  // The steps that start or finish a task change the history the checker
+  // sees, so they never commute with each other.
+  bool ConflictsWith(const DporStep& other) const;
+
+  // Adds the other step, so this one conflicts with everything either
+  // conflicts with.
+  void Merge(const DporStep& other);
+};
+
+// DporTrace is the current execution of DporScheduler: the states of it with
+// their backtrack and sleep sets, and the steps between them. It finds the
+// races of the steps and adds the threads that reverse them to the backtrack
+// sets of the earlier states, the tasks themselves are run by the scheduler.
+class DporTrace {
+ public:
+  // Thread of the sleep set: its step from the state is explored, so it's
+  // not taken until a step that conflicts with it is made.
+  struct Sleeper {
+    size_t thread;
+    DporStep step;
+  };
+
+  struct State {
+    // Can the thread make a step from the state.
+    std::vector<bool> enabled;
+    // Threads to take from the state, and the taken ones.
+    std::vector<bool> backtrack;
+    std::vector<bool> done;
+    std::vector<Sleeper> sleep;
+    // The step made from the state, see Take().
+    size_t thread{};
+    DporStep step;
+    // Vector clock of the step: clock[t] is the number of the steps of the
+    // execution up to the last step of the thread t that happens before
+    // this one or is it.
+    std::vector<size_t> clock;
+  };
+
+  explicit DporTrace(size_t threads_count) : threads_count(threads_count) {}
+
+  // Pushes the state after the last step. The threads asleep before the
+  // step stay asleep if it commutes with their steps. Returns false if all
+  // the enabled threads are asleep, then every execution from the state is
+  // equivalent to an explored one.
+  bool Push(std::vector<bool> enabled);
+
+  void Pop() { states.pop_back(); }
+
+  // Returns the next thread of the backtrack set of the last state that is
+  // enabled, not taken and not asleep, and marks it taken.
+  std::optional<size_t> NextThread();
+
+  // Records the step the thread has made from the last state and adds the
+  // threads that reverse its races to the backtrack sets.
+  void Take(size_t thread, DporStep step);
+
+  // Puts the thread of the last state to sleep after its branch with all
+  // the steps it has made from the state.
+  void Sleep(size_t thread, DporStep step);
+
+  // The round is over when max_tasks tasks are finished, so the threads that
+  // could start another task never do it, and no race with their starts is
+  // found. A start conflicts with the other steps of the history, so it's
+  // raced with the last one of them that doesn't happen before it and could
+  // be taken instead of it, before the limit of the tasks was reached.
+  // can_start[t] tells if the thread t has no running task and could start
+  // another one.
+  void ReversePendingStarts(const std::vector<bool>& can_start);
+
+  bool IsAsleep(size_t state, size_t thread) const;
+
+  // Checks if the step i happens before the step j.
+  bool HappensBefore(size_t i, size_t j) const {
+    return states[j].clock[states[i].thread] > i;
+  }
+
+  size_t Size() const { return states.size(); }
+  bool Empty() const { return states.empty(); }
+  const State& operator[](size_t i) const { return states[i]; }
+  void Clear() { states.clear(); }
+
+ private:
+  // Computes the clock of the last step and finds the earlier steps it races
+  // with: the steps of the other threads that conflict with it and happen
+  // before it only through the direct conflict.
+  void DetectRaces(size_t last);
+
+  // Makes sure a thread that can start the reversed race is in the backtrack
+  // set before the step `first`.
+  void ReverseRace(size_t first, size_t second);
+
+  size_t threads_count;
+  std::vector<State> states;
+};
+
+}  // namespace ltest
@@ -0,0 +1,61 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace ltest {
+
+// FenwickTree keeps the weights of the threads, so a thread can be picked
+// with the probability proportional to its weight in O(log threads), and a
+// weight can be changed in O(log threads).
+class FenwickTree {
+ public:
+  // Makes the weights of the threads [0, size) zero.
+  void Reset(size_t size) {
+    tree.assign(size + 1, 0);
+    weights.assign(size, 0);
+    total = 0;
+  }
+
+  void Set(size_t index, long weight) {
+    auto delta = weight - weights[index];
+    if (delta == 0) {
+      return;
+    }
+    weights[index] = weight;
+    total += delta;
+    for (size_t i = index + 1; i < tree.size(); i += i & (~i + 1)) {
+      tree[i] += delta;
+    }
+  }
+
+  long Total() const { return total; }
+
+  // Returns the index such that the sum of the weights before it is not
+  // greater than value and the sum including it is greater, value < Total().
+  size_t Find(long value) const {
+    assert(0 <= value && value < total);
+    size_t pos = 0;
+    size_t step = 1;
+    while (step * 2 < tree.size()) {
+      step *= 2;
+    }
+    for (; step > 0; step /= 2) {
+      if (pos + step < tree.size() && tree[pos + step] <= value) {
+        pos += step;
+        value -= tree[pos];
+      }
+    }
+    return pos;
+  }
+
+  long Get(size_t index) const { return weights[index]; }
+
+ private:
+  // tree[i] is the sum of the weights (i - lowbit(i), i].
+  std::vector<long> tree;
+  std::vector<long> weights;
+  long total{};
+};
+
+}  // namespace ltest
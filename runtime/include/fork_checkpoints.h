@@ -0,0 +1,60 @@
+#pragma once
+#include <sys/types.h>
+
+#include <cstddef>
+
+namespace ltest {
+
+// ForkCheckpoints lets TLAScheduler backtrack without replaying the frames
+// from the beginning. At a checkpoint step every branch is explored by a
+// forked child, while the parent stays frozen in the state of the step, so
+// after the branch it continues with the next one right away.
+// A fork replaces the replay of one branch, so it pays off when the replay
+// is longer than the fork, that is, from some depth on. Every stride-th step
+// from the depth is a checkpoint: a fork at each step costs more than it
+// saves when the steps are short, while the branches of the steps between
+// the checkpoints are still replayed.
+// A child that explores its subtree reports the finished rounds and exits.
+// A child that finishes the exploration (finds a bug or runs out of rounds)
+// takes over: it returns its result as the main process, and its ancestors
+// exit with its exit status once it's done.
+class ForkCheckpoints {
+ public:
+  // Makes the steps depth, depth + stride, ... checkpoints, the depth 0
+  // disables them.
+  ForkCheckpoints(size_t depth, size_t stride);
+  ForkCheckpoints(const ForkCheckpoints&) = delete;
+  ForkCheckpoints& operator=(const ForkCheckpoints&) = delete;
+  ~ForkCheckpoints();
+
+  bool IsCheckpoint(size_t step) const {
+    return depth != 0 && step >= depth && (step - depth) % stride == 0;
+  }
+
+  // Forks the process, returns true in the child.
+  bool Fork();
+
+  // Waits for the child, returns the number of the rounds finished after it.
+  // Exits with the status of the child if it has taken over or crashed.
+  size_t Wait();
+
+  // The child reports the number of the finished rounds and exits.
+  [[noreturn]] void ExitChild(size_t finished_rounds);
+
+  // The child continues as the main process.
+  void TakeOver();
+
+ private:
+  // State shared by the processes.
+  struct Shared {
+    size_t finished_rounds;
+    bool taken_over;
+  };
+
+  size_t depth;
+  size_t stride;
+  Shared* shared{};
+  pid_t child{-1};
+};
+
+}  // namespace ltest
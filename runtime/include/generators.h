@@ -8,8 +8,6 @@ namespace ltest {
 
 namespace generators {
 
-extern std::shared_ptr<Token> generated_token;
-
 // Makes single argument from the value.
 template <typename T>
 auto makeSingleArg(T&& arg) {
@@ -17,9 +15,14 @@ auto makeSingleArg(T&& arg) {
   return std::tuple<arg_type>{std::forward<arg_type>(arg)};
 }
 
-std::tuple<> genEmpty(size_t thread_num);
+// Returns a random number from [from, to]. The generator is seeded for each
+// round, so the targets use it instead of rand() to make the rounds
+// reproducible by the seed.
+int randomInt(int from, int to);
+
+std::tuple<> genEmpty();
 
-std::tuple<std::shared_ptr<Token>> genToken(size_t thread_num);
+std::tuple<std::shared_ptr<Token>> genToken();
 
 }  // namespace generators
 
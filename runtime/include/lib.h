@@ -1,30 +1,30 @@
 #pragma once
 #include <valgrind/memcheck.h>
 
-#include <boost/context/detail/fcontext.hpp>
-#include <boost/context/fiber.hpp>
-#include <boost/context/fiber_fcontext.hpp>
+#include <atomic>
 #include <cassert>
+#include <concepts>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <optional>
+#include <random>
 #include <string>
+#include <tuple>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "coro_context.h"
+#include "logger.h"
+#include "round_heap.h"
+#include "task_arena.h"
 #include "value_wrapper.h"
 
 #define panic() assert(false)
 
 struct CoroBase;
-struct CoroutineStatus;
-
-// Current executing coroutine.
-extern std::shared_ptr<CoroBase> this_coro;
-
-extern boost::context::fiber_context sched_ctx;
-
-extern std::optional<CoroutineStatus> coroutine_status;
 
 struct CoroutineStatus{
   std::string_view name;
@@ -36,34 +36,285 @@ struct CoroutineStatus{
 struct Token {
   // Parks the task. Yields.
   void Park();
+  // Parks the task until the task of the holder token unparks it, e.g. the
+  // holder of the lock the task waits for. The runtime terminates the holder
+  // first, and a cycle of such waits is a deadlock, see
+  // ltest::TaskTerminator.
+  void Park(const Token& holder);
   // Unpark the task parked by token.
   void Unpark();
 
+  // Returns the task the token is set to, see CoroBase::SetToken().
+  CoroBase* GetOwner() const { return owner; }
+  // Returns the holder the parked task waits for, or nullptr if any task
+  // may unpark it.
+  const Token* GetHolder() const { return holder; }
+
  private:
   // Resets the token.
   void Reset();
   // If token is parked.
   bool parked{};
+  CoroBase* owner{};
+  const Token* holder{};
 
   friend class CoroBase;
 };
 
+namespace ltest {
+
+// FutexQueues emulates the futexes of the tasks: the tasks waiting on an
+// address are queued, and a wake resumes the first of them in O(woken). The
+// blocked tasks are not scheduled until they are woken, so like the real
+// futex, a changed value without a wake doesn't wake anyone.
+class FutexQueues {
+ public:
+  // FUTEX_WAIT: blocks the task on the address if the value there is still
+  // the expected one, returns false otherwise.
+  bool Wait(CoroBase* task, int* addr, int expected);
+
+  // FUTEX_WAKE: wakes up to count tasks blocked on the address, returns the
+  // number of the woken tasks.
+  size_t Wake(int* addr, size_t count);
+
+  // Removes the blocked task from the queue of its address.
+  void Remove(CoroBase* task);
+
+ private:
+  std::unordered_map<int*, std::deque<CoroBase*>> queues;
+};
+
+// Mixes the bits of the value (splitmix64), so close values give unrelated
+// seeds.
+constexpr uint64_t MixSeed(uint64_t x) {
+  x += 0x9e3779b97f4a7c15;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+  return x ^ (x >> 31);
+}
+
+// Returns the seed of the round: every random choice of the round is derived
+// from it, so the run seed and the round index determine the round. The
+// rounds are numbered across the workers and the forked children.
+constexpr uint64_t GetRoundSeed(uint64_t seed, size_t round) {
+  return MixSeed(seed ^ MixSeed(round));
+}
+
+// RuntimeContext is the mutable state of one exploration. The runtime reaches
+// it through the thread-local pointer, so several schedulers can explore
+// rounds on different threads of one process, see the workers option.
+struct RuntimeContext {
+  // Current executing coroutine.
+  CoroBase* this_coro{};
+  // Last status change reported by the executing coroutine.
+  std::optional<CoroutineStatus> coroutine_status;
+  // Token made by generators::genToken() for the task which arguments are
+  // being generated.
+  std::shared_ptr<Token> generated_token;
+  Logger logger;
+  // Are syscalls of the tasks trapped, see SyscallTrapGuard.
+  bool trap_syscall{};
+  // Is set when the exploration has to stop, e.g. another worker has found a
+  // nonlinearizable history.
+  const std::atomic<bool>* stop{};
+  // Yield budget the running task has given up, see Token::Unpark().
+  size_t dropped_yield_budget{};
+  // Number of the Unpark() and futex wake calls, the strategies check the
+  // waiting threads again when it changes.
+  size_t wakeups{};
+  // Wait queues of the futexes of the tasks.
+  FutexQueues futexes;
+  // Index of the current round, see GetRoundSeed().
+  size_t round{};
+  // Generator of the target arguments, see generators::randomInt().
+  std::mt19937 rng;
+
+  // Seeds the generator of the arguments for the round.
+  void StartRound(size_t index, uint64_t round_seed) {
+    round = index;
+    rng.seed(MixSeed(round_seed));
+  }
+
+  bool IsStopped() const {
+    return stop != nullptr && stop->load(std::memory_order_relaxed);
+  }
+};
+
+// Context of the current thread. Threads that don't install their own context
+// share the default one.
+extern constinit thread_local RuntimeContext* runtime_context;
+
+inline RuntimeContext& GetRuntimeContext() { return *runtime_context; }
+
+// Makes the context current for the thread while the guard is alive.
+class RuntimeContextGuard {
+ public:
+  explicit RuntimeContextGuard(RuntimeContext& ctx)
+      : prev(std::exchange(runtime_context, &ctx)) {}
+  RuntimeContextGuard(const RuntimeContextGuard&) = delete;
+  RuntimeContextGuard& operator=(const RuntimeContextGuard&) = delete;
+  ~RuntimeContextGuard() { runtime_context = prev; }
+
+ private:
+  RuntimeContext* prev;
+};
+
+}  // namespace ltest
+
 extern "C" void CoroYield();
 
+// Number of yields the running task makes without switching to the
+// scheduler, see CoroYieldFast().
+extern "C" constinit thread_local size_t ltest_yield_budget;
+
+// Fast path of CoroYield(): while the running task has the yield budget, the
+// yield only decrements it. The strategy gives the budget, see
+// Strategy::GetYieldBudget(); parking, futexes and status changes switch
+// regardless of it. YieldPass inserts calls to it into the target
+// methods, where it's inlined, so it's kept in the module even if it is not
+// used in the source.
+extern "C" [[gnu::used]] inline void CoroYieldFast() {
+  if (ltest_yield_budget > 0) {
+    --ltest_yield_budget;
+    return;
+  }
+  CoroYield();
+}
+
+namespace ltest {
+
+// Kind of the memory access of a task, YieldPass reports it as an int.
+// kUnknown is reported for the code that may access any memory.
+enum class AccessKind : int {
+  kRead = 0,
+  kWrite = 1,
+  kReadWrite = 2,
+  kUnknown = 3
+};
+
+// Access of the size bytes from the address, the size is zero if only the
+// address is known, then the access may be anywhere.
+struct Access {
+  const void* address;
+  size_t size;
+  AccessKind kind;
+};
+
+// StepAccesses are the memory accesses of a task from a resume to the next
+// yield that YieldPass has reported. The locals that don't escape are
+// reported without the address. A step of the code that isn't instrumented
+// reports nothing, its accesses are unknown.
+struct StepAccesses {
+  std::vector<Access> accesses;
+  // Has the step reported anything.
+  bool is_reported{};
+  // Has the step reported an access of the unknown memory.
+  bool is_unknown{};
+
+  void Clear() {
+    accesses.clear();
+    is_reported = false;
+    is_unknown = false;
+  }
+
+  // Adds the accesses of the other step.
+  void Merge(const StepAccesses& other);
+
+  // Checks if the steps may not commute: one of them is unknown, or their
+  // accesses overlap and one of them writes.
+  bool ConflictsWith(const StepAccesses& other) const;
+};
+
+}  // namespace ltest
+
+// Accesses of the running step if the scheduler tracks them, see
+// CoroAccess().
+extern "C" constinit thread_local ltest::StepAccesses* ltest_step_accesses;
+
+// Records the access of the running task, the kind is ltest::AccessKind and
+// the address is null for a local. YieldPass inserts it before the memory
+// accesses of the functions the target methods call, and before the calls
+// of the functions it can't instrument.
+extern "C" [[gnu::used]] inline void CoroAccess(const void* address,
+                                                size_t size, int kind) {
+  if (ltest_step_accesses == nullptr) {
+    return;
+  }
+  ltest_step_accesses->is_reported = true;
+  if (kind == static_cast<int>(ltest::AccessKind::kUnknown)) {
+    ltest_step_accesses->is_unknown = true;
+  } else if (address != nullptr) {
+    // The scheduler keeps the accesses after the round heap is rewound, so
+    // they are not in the round heap.
+    ltest::RoundHeapScope scope{false};
+    ltest_step_accesses->accesses.push_back(
+        ltest::Access{address, size, static_cast<ltest::AccessKind>(kind)});
+  }
+}
+
+// Yield after the access, YieldPass inserts it after the loads, the stores
+// and the atomic instructions of the target methods.
+extern "C" void CoroYieldAccess(const void* address, size_t size, int kind);
+
+// Inlined CoroYieldAccess(), see CoroYieldFast().
+extern "C" [[gnu::used]] inline void CoroYieldAccessFast(const void* address,
+                                                         size_t size,
+                                                         int kind) {
+  CoroAccess(address, size, kind);
+  CoroYieldFast();
+}
+
 extern "C" void CoroutineStatusChange(char* coroutine, bool start);
 
-struct CoroBase : public std::enable_shared_from_this<CoroBase> {
+namespace ltest {
+
+// Methods are interned into dense ids when target_method registers them, so
+// strategies, verifiers and checkers compare and index methods by ids instead
+// of names.
+using MethodId = size_t;
+
+// Returns the id of the method, the first call with the name interns it.
+MethodId GetMethodId(std::string_view name);
+
+// Returns the name of the interned method.
+std::string_view GetMethodName(MethodId id);
+
+// Returns the number of interned methods, ids are less than it.
+size_t GetMethodsCount();
+
+}  // namespace ltest
+
+namespace ltest {
+
+// Compares the arguments of two tasks, the arguments of the types without ==
+// are never equal.
+template <typename... Args>
+bool ArgsEqual(const std::tuple<Args...>& a, const std::tuple<Args...>& b) {
+  if constexpr ((std::equality_comparable<Args> && ...)) {
+    return a == b;
+  } else {
+    return false;
+  }
+}
+
+}  // namespace ltest
+
+struct CoroBase {
   CoroBase(const CoroBase&) = delete;
   CoroBase(CoroBase&&) = delete;
   CoroBase& operator=(CoroBase&&) = delete;
 
   // Restart the coroutine from the beginning passing this_ptr as this.
-  // Returns restarted coroutine.
-  virtual std::shared_ptr<CoroBase> Restart(void* this_ptr) = 0;
+  // The coroutine is reinitialized in place, returns this.
+  virtual CoroBase* Restart(void* this_ptr) = 0;
 
   // Resume the coroutine to the next yield.
   void Resume();
 
+  // Resumes the coroutine letting it make up to yield_budget yields without
+  // switching back, see CoroYieldFast(). Returns the number of such yields.
+  size_t Resume(size_t yield_budget);
+
   // Check if the coroutine is returned.
   bool IsReturned() const;
 
@@ -76,15 +327,21 @@ struct CoroBase : public std::enable_shared_from_this<CoroBase> {
   // Returns the name of the coroutine.
   virtual std::string_view GetName() const;
 
+  // Returns the id of the coroutine method.
+  virtual ltest::MethodId GetMethodId() const;
+
   // Returns the args as strings.
   virtual std::vector<std::string> GetStrArgs() const = 0;
 
   // Returns raw pointer to the tuple arguments.
   virtual void* GetArgs() const = 0;
 
-  // Returns new pointer to the coroutine.
-  // https://en.cppreference.com/w/cpp/memory/enable_shared_from_this
-  std::shared_ptr<CoroBase> GetPtr();
+  // Returns the hash of GetStrArgs(), it's computed once per task. The tasks
+  // with the same arguments have the same hash.
+  uint64_t GetArgsHash() const;
+
+  // Checks if the other task of the same method has equal arguments.
+  virtual bool HasEqualArgs(const CoroBase& other) const = 0;
 
   // Terminate the coroutine.
   void Terminate();
@@ -92,27 +349,19 @@ struct CoroBase : public std::enable_shared_from_this<CoroBase> {
   // Sets the token.
   void SetToken(std::shared_ptr<Token>);
 
-  struct FutexState {
-    int* addr;
-    int value;
-  };
-
-  inline void SetBlocked(long uaddr, int value) {
-    fstate = {reinterpret_cast<int*>(uaddr), value};
-  }
-
-  inline bool IsBlocked() {
-    /// Check that value stored by futex addr isn't changed
-    bool is_blocked = fstate.addr && *fstate.addr == fstate.value;
-    if (!is_blocked) {
-      fstate = FutexState{nullptr, 0};
-    }
-    return is_blocked;
-  }
+  // Checks if the coroutine waits on a futex, see ltest::FutexQueues.
+  bool IsBlocked() const { return futex != nullptr; }
 
   // Checks if the coroutine is parked.
   bool IsParked() const;
 
+  // Returns the token of the coroutine or nullptr.
+  const Token* GetToken() const { return token.get(); }
+
+  // Wakes the parked or blocked coroutine spuriously, it has to check the
+  // condition it waits for again.
+  void Wake();
+
   virtual ~CoroBase();
 
  protected:
@@ -123,6 +372,10 @@ struct CoroBase : public std::enable_shared_from_this<CoroBase> {
 
   template <typename Target, typename... Args>
   friend class Coro;
+  friend class ltest::FutexQueues;
+
+  // Removes the coroutine from the futex wait queue.
+  void Unblock();
 
   // Task id.
   int id;
@@ -130,25 +383,40 @@ struct CoroBase : public std::enable_shared_from_this<CoroBase> {
   ValueWrapper ret{};
   // Is coroutine returned.
   bool is_returned{};
-  // Futex state on which coroutine is blocked.
-  FutexState fstate{};
-  // Name.
-  std::string_view name;
+  // Address of the futex the coroutine is blocked on.
+  int* futex{};
+  // Id of the method.
+  ltest::MethodId method_id;
+  // See GetArgsHash(), the arguments are kept on Restart().
+  mutable std::optional<uint64_t> args_hash;
   // Token.
   std::shared_ptr<Token> token{};
-  boost::context::fiber_context ctx;
+  // Execution context.
+  ltest::CoroContext ctx;
 };
 
 template <typename Target, typename... Args>
 struct Coro final : public CoroBase {
-  // CoroF is a target class method.
-  using CoroF = std::function<ValueWrapper(Target*, Args...)>;
-  // ArgsToStringF converts arguments to the strings for pretty printing.
-  using ArgsToStringsF =
-      std::function<std::vector<std::string>(std::shared_ptr<void>)>;
+  // Method calls the target class method, see ltest::TargetMethod.
+  using Method = ValueWrapper (*)(Target*, Args...);
+  // ArgsToStrings converts arguments to the strings for pretty printing.
+  using ArgsToStrings =
+      std::vector<std::string> (*)(const std::tuple<Args...>&);
 
   // unsafe: caller must ensure that this_ptr points to Target.
-  std::shared_ptr<CoroBase> Restart(void* this_ptr) override {
+  Coro(Method method, void* this_ptr, std::tuple<Args...> args,
+       ArgsToStrings args_to_strings, ltest::MethodId method_id, int task_id)
+      : method(method),
+        args(std::move(args)),
+        args_to_strings(args_to_strings),
+        this_ptr(this_ptr) {
+    this->method_id = method_id;
+    this->id = task_id;
+    ctx.Start(&Coro::Run, this);
+  }
+
+  // unsafe: caller must ensure that this_ptr points to Target.
+  CoroBase* Restart(void* this_ptr) override {
     /**
      *  The task must be returned if we want to restart it.
      *   We can't just Terminate() it because it is the runtime responsibility
@@ -156,36 +424,12 @@ struct Coro final : public CoroBase {
      *
      */
     assert(IsReturned());
-    auto coro = New(func, this_ptr, args, args_to_strings, name, id);
-    if (token != nullptr) {
-      coro->token = std::move(token);
-    }
-    return coro;
-  }
-
-  // unsafe: caller must ensure that this_ptr points to Target.
-  static std::shared_ptr<CoroBase> New(CoroF func, void* this_ptr,
-                                       std::shared_ptr<void> args,
-                                       ArgsToStringsF args_to_strings,
-                                       std::string_view name, int task_id) {
-    auto c = std::make_shared<Coro>();
-    c->func = std::move(func);
-    c->args = std::move(args);
-    c->name = name;
-    c->id = task_id;
-    c->args_to_strings = std::move(args_to_strings);
-    c->this_ptr = this_ptr;
-    c->ctx =
-        boost::context::fiber_context([c](boost::context::fiber_context&& ctx) {
-          auto real_args =
-              reinterpret_cast<std::tuple<Args...>*>(c->args.get());
-          auto this_arg =
-              std::tuple<Target*>{reinterpret_cast<Target*>(c->this_ptr)};
-          c->ret = std::apply(c->func, std::tuple_cat(this_arg, *real_args));
-          c->is_returned = true;
-          return std::move(ctx);
-        });
-    return c;
+    this->this_ptr = this_ptr;
+    ret = ValueWrapper{};
+    is_returned = false;
+    Unblock();
+    ctx.Start(&Coro::Run, this);
+    return this;
   }
 
   std::vector<std::string> GetStrArgs() const override {
@@ -193,36 +437,101 @@ struct Coro final : public CoroBase {
     return args_to_strings(args);
   }
 
-  void* GetArgs() const override { return args.get(); }
+  void* GetArgs() const override {
+    return const_cast<std::tuple<Args...>*>(&args);
+  }
+
+  bool HasEqualArgs(const CoroBase& other) const override {
+    auto other_coro = dynamic_cast<const Coro*>(&other);
+    return other_coro != nullptr && ltest::ArgsEqual(args, other_coro->args);
+  }
 
  private:
+  // Entry of the coroutine context, arg points to the Coro.
+  static void Run(void* arg) {
+    auto c = static_cast<Coro*>(arg);
+    auto target = reinterpret_cast<Target*>(c->this_ptr);
+    ValueWrapper ret;
+    {
+      ltest::RoundHeapScope scope{true};
+      ret = std::apply(
+          [c, target](const Args&... args) {
+            return c->method(target, args...);
+          },
+          c->args);
+    }
+    // The result may be in the round heap, and the task outlives its rewind,
+    // so the task keeps a copy made outside of the heap.
+    c->ret = ret;
+    c->is_returned = true;
+  }
+
   // Function to execute.
-  CoroF func;
-  // Pointer to the arguments, points to the std::tuple<Args...>.
-  std::shared_ptr<void> args;
+  Method method;
+  // The arguments, the method gets their copies.
+  std::tuple<Args...> args;
   // Function that can make strings from args for pretty printing.
-  std::function<std::vector<std::string>(std::shared_ptr<void>)>
-      args_to_strings;
+  ArgsToStrings args_to_strings;
   // Raw pointer to the target class object.
   void* this_ptr;
 };
 
-using Task = std::shared_ptr<CoroBase>;
+// Tasks live in the TaskArena of the round, so Task is a plain pointer.
+using Task = CoroBase*;
+
+namespace ltest {
+
+// Returns the I-th argument of the task, args is CoroBase::GetArgs() of the
+// task which arguments are the Tuple. The argument is not copied, so the
+// specs read it right from the task.
+template <size_t I, typename Tuple>
+const std::tuple_element_t<I, Tuple>& GetArg(void* args) {
+  return std::get<I>(*static_cast<const Tuple*>(args));
+}
 
-// (this_ptr, thread_num, task_id) -> Task
+}  // namespace ltest
 
 struct TaskBuilder {
-  using BuilderFunc = std::function<Task(void*, size_t, int)>;
-  TaskBuilder(std::string name, BuilderFunc func)
-      : name(name), builder_func(func) {}
+  // (thread_num) -> arguments of a task built for the thread
+  using ArgsFunc = std::function<ValueWrapper(size_t)>;
+  // (arena, this_ptr, args, task_id) -> Task
+  using BuilderFunc = std::function<Task(ltest::TaskArena&, void*,
+                                         const ValueWrapper&, int)>;
+  TaskBuilder(std::string name, ArgsFunc gen_args, BuilderFunc func,
+              bool is_thread_independent = false)
+      : name(name),
+        method_id(ltest::GetMethodId(name)),
+        gen_args(std::move(gen_args)),
+        builder_func(func),
+        is_thread_independent(is_thread_independent) {}
 
   const std::string& GetName() const { return name; }
 
-  Task Build(void* this_ptr, size_t thread_id, int task_id) {
-    return builder_func(this_ptr, thread_id, task_id);
+  ltest::MethodId GetMethodId() const { return method_id; }
+
+  // Returns true if the arguments of the tasks don't depend on the thread
+  // they are built for, see TargetMethod.
+  bool IsThreadIndependent() const { return is_thread_independent; }
+
+  // Generates the arguments of a task of the thread, they are drawn from
+  // the runtime generator, see ltest::Scenario.
+  ValueWrapper GenArgs(size_t thread_id) const { return gen_args(thread_id); }
+
+  Task Build(ltest::TaskArena& arena, void* this_ptr, const ValueWrapper& args,
+             int task_id) const {
+    return builder_func(arena, this_ptr, args, task_id);
+  }
+
+  // Builds the task with new arguments.
+  Task Build(ltest::TaskArena& arena, void* this_ptr, size_t thread_id,
+             int task_id) const {
+    return Build(arena, this_ptr, GenArgs(thread_id), task_id);
   }
 
  private:
   std::string name;
+  ltest::MethodId method_id;
+  ArgsFunc gen_args;
   BuilderFunc builder_func;
+  bool is_thread_independent;
 };
@@ -5,6 +5,7 @@
 #include <stdexcept>
 #include <unordered_set>
 #include <variant>
+#include <vector>
 
 #include "lib.h"
 #include "value_wrapper.h"
@@ -75,7 +76,8 @@ struct LinearizabilityChecker : ModelChecker {
   bool Check(const std::vector<HistoryEvent>& fixed_history) override;
 
  private:
-  MethodMap specification_methods;
+  // Specification methods indexed by the method ids.
+  std::vector<Method> specification_methods;
   LinearSpecificationObject first_state;
 };
 
@@ -112,12 +114,19 @@ LinearizabilityChecker<LinearSpecificationObject, SpecificationObjectHash,
     LinearizabilityChecker(
         LinearizabilityChecker::MethodMap specification_methods,
         LinearSpecificationObject first_state)
-    : specification_methods(specification_methods), first_state(first_state) {
+    : first_state(first_state) {
   if (!std::is_copy_assignable_v<LinearSpecificationObject>) {
     // TODO: should do it in the compile time
     throw std::invalid_argument(
         "LinearSpecificationObject type have to be is_copy_assignable_v");
   }
+  for (auto& [name, method] : specification_methods) {
+    auto id = ltest::GetMethodId(name);
+    if (id >= this->specification_methods.size()) {
+      this->specification_methods.resize(id + 1);
+    }
+    this->specification_methods[id] = std::move(method);
+  }
 }
 
 // Implements the wgl linearizability checker,
@@ -159,10 +168,10 @@ bool LinearizabilityChecker<
     if (history[current_section_start].index() == 0) {
       // invoke
       const Invoke& inv = std::get<0>(history[current_section_start]);
-      assert(specification_methods.find(inv.GetTask()->GetName()) !=
-             specification_methods.end());
-      auto method =
-          specification_methods.find(inv.GetTask()->GetName())->second;
+      auto method_id = inv.GetTask()->GetMethodId();
+      assert(method_id < specification_methods.size() &&
+             specification_methods[method_id]);
+      const auto& method = specification_methods[method_id];
       // apply method
       bool was_checked = false;
       LinearSpecificationObject data_structure_state_copy =
@@ -173,7 +182,10 @@ bool LinearizabilityChecker<
       bool doesnt_have_response =
           (inv_res.find(current_section_start) == inv_res.end());
 
-      if (doesnt_have_response || res == inv.GetTask()->GetRetVal()) {
+      bool res_matches =
+          doesnt_have_response || res == inv.GetTask()->GetRetVal();
+
+      if (res_matches) {
         // We can append this event to a linearization
         linearized[current_section_start] = true;
         linearized_entries_count++;
@@ -200,8 +212,7 @@ bool LinearizabilityChecker<
 
       // haven't seen this state previously, so continue procedure with this new
       // state
-      if ((doesnt_have_response || res == inv.GetTask()->GetRetVal()) &&
-          !was_checked) {
+      if (res_matches && !was_checked) {
         // open section
         open_sections_stack.push_back(current_section_start);
         states_stack.push_back(data_structure_state);
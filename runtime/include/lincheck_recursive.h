@@ -2,6 +2,7 @@
 
 #include <functional>
 #include <numeric>
+#include <vector>
 
 #include "lincheck.h"
 
@@ -23,7 +24,8 @@ struct LinearizabilityCheckerRecursive : ModelChecker {
   bool Check(const std::vector<HistoryEvent>& fixed_history) override;
 
  private:
-  MethodMap specification_methods;
+  // Specification methods indexed by the method ids.
+  std::vector<Method> specification_methods;
   LinearSpecificationObject first_state;
 };
 
@@ -35,12 +37,19 @@ LinearizabilityCheckerRecursive<LinearSpecificationObject,
     LinearizabilityCheckerRecursive(
         LinearizabilityCheckerRecursive::MethodMap specification_methods,
         LinearSpecificationObject first_state)
-    : specification_methods(specification_methods), first_state(first_state) {
+    : first_state(first_state) {
   if (!std::is_copy_assignable_v<LinearSpecificationObject>) {
     // TODO: should do it in the compile time
     throw std::invalid_argument(
         "LinearSpecificationObject type have to be is_copy_assignable_v");
   }
+  for (auto& [name, method] : specification_methods) {
+    auto id = ltest::GetMethodId(name);
+    if (id >= this->specification_methods.size()) {
+      this->specification_methods.resize(id + 1);
+    }
+    this->specification_methods[id] = std::move(method);
+  }
 }
 
 template <class LinearSpecificationObject, class SpecificationObjectHash,
@@ -83,12 +92,10 @@ bool LinearizabilityCheckerRecursive<
       }
 
       Invoke minimal_op = std::get<Invoke>(history[i]);
-      assert(specification_methods.find(
-                 std::string{minimal_op.GetTask()->GetName()}) !=
-             specification_methods.end());
-      auto method = specification_methods
-                        .find(std::string{minimal_op.GetTask()->GetName()})
-                        ->second;
+      auto method_id = minimal_op.GetTask()->GetMethodId();
+      assert(method_id < specification_methods.size() &&
+             specification_methods[method_id]);
+      const auto& method = specification_methods[method_id];
 
       LinearSpecificationObject data_structure_state_copy =
           data_structure_state;
@@ -30,8 +30,9 @@
  */
 struct SmartMinimizor : public RoundMinimizor {
   SmartMinimizor() = delete;
+  // The mutations are random, seed makes them reproducible.
   explicit SmartMinimizor(int exploration_runs, int minimization_runs,
-                          PrettyPrinter& pretty_printer,
+                          PrettyPrinter& pretty_printer, uint64_t seed,
                           // algorithm params
                           int max_offsprings_per_generation = 5,
                           int offsprings_generation_attemps = 10,
@@ -1,7 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <limits>
 #include <random>
+#include <set>
+#include <utility>
+#include <vector>
 
 #include "scheduler.h"
 
@@ -10,34 +15,27 @@
 // Although it's impossible to predict the exact number of switches(since it's
 // equivalent to the halt problem), k should be good approximation
 template <typename TargetObj, StrategyVerifier Verifier>
-struct PctStrategy : public BaseStrategyWithThreads<TargetObj, Verifier> {
+struct PctStrategy final
+    : public BaseStrategyWithThreads<TargetObj, Verifier> {
   // forbid_all_same indicates whether it is allowed to have all same tasks(same
   // methods) in any moment of execution. Useful for blocking structures, for
   // instance, you don't want to run mutex.lock in each thread
   explicit PctStrategy(size_t threads_count,
-                       std::vector<TaskBuilder> constructors,
+                       std::vector<TaskBuilder> constructors, size_t max_tasks,
                        bool forbid_all_same)
       : threads_count(threads_count),
+        max_tasks(max_tasks),
         current_depth(1),
         current_schedule_length(0),
         forbid_all_same(forbid_all_same) {
     this->constructors = std::move(constructors);
     this->round_schedule.resize(threads_count, -1);
 
-    std::random_device dev;
-    rng = std::mt19937(dev());
     this->constructors_distribution =
         std::uniform_int_distribution<std::mt19937::result_type>(
             0, this->constructors.size() - 1);
 
-    // We have information about potential number of resumes
-    // but because of the implementation, it's only available in the task.
-    // In fact, it doesn't depend on the task, it only depends on the
-    // constructor
-    size_t avg_k = 0;
-    avg_k = avg_k / this->constructors.size();
-
-    PrepareForDepth(current_depth, avg_k);
+    PrepareForDepth(current_depth, EstimateScheduleLength());
 
     // Create queues.
     for (size_t i = 0; i < threads_count; ++i) {
@@ -49,60 +47,35 @@ struct PctStrategy : public BaseStrategyWithThreads<TargetObj, Verifier> {
   // is equal to the max_tasks the finished task will be returned
   TaskWithMetaData Next() override {
     auto& threads = this->threads;
-    size_t max = std::numeric_limits<size_t>::min();
-    size_t index_of_max = 0;
-    // Have to ignore waiting threads, so can't do it faster than O(n)
-    for (size_t i = 0; i < threads.size(); ++i) {
-      // Ignore waiting tasks
-      if (!threads[i].empty() &&
-          (threads[i].back()->IsParked() || threads[i].back()->IsBlocked())) {
-        // dual waiting if request finished, but follow up isn't
-        // skip dual tasks that already have finished the request
-        // section(follow-up will be executed in another task, so we can't
-        // resume)
-        continue;
-      }
-
-      if (max <= priorities[i]) {
-        max = priorities[i];
-        index_of_max = i;
-      }
-    }
-
-    assert((max != std::numeric_limits<size_t>::min() &&
-            "all threads are empty or parked"));
-
-    // Check whether the priority change is required
-    current_schedule_length++;
-    for (size_t i = 0; i < priority_change_points.size(); ++i) {
-      if (current_schedule_length == priority_change_points[i]) {
-        priorities[index_of_max] = current_depth - i;
-      }
-    }
+    this->UpdateRunnable(RunnableMode::kGenerate);
+    size_t index_of_max = PickMaxPriority();
+    this->OnPicked(index_of_max);
 
     if (threads[index_of_max].empty() ||
         threads[index_of_max].back()->IsReturned()) {
-      auto constructor =
-          this->constructors.at(this->constructors_distribution(rng));
+      const auto& task = this->scenario.Next(index_of_max);
+      auto constructor = &this->constructors.at(task.constructor);
       if (forbid_all_same) {
-        auto names = CountNames(index_of_max);
+        auto methods = CountMethods(index_of_max);
         // TODO: выглядит непонятно и так себе
         while (true) {
-          auto name = constructor.GetName();
-          names.insert(name);
-          CreatedTaskMetaData task = {name, true, index_of_max};
-          if (names.size() == 1 || !this->sched_checker.Verify(task)) {
+          auto method_id = constructor->GetMethodId();
+          methods.Insert(method_id);
+          CreatedTaskMetaData task = {method_id, true, index_of_max};
+          if (methods.size == 1 || !this->sched_checker.Verify(task)) {
             constructor =
-                this->constructors.at(this->constructors_distribution(rng));
+                &this->constructors.at(this->constructors_distribution(rng));
           } else {
             break;
           }
         }
       }
 
-      threads[index_of_max].emplace_back(
-          constructor.Build(&this->state, index_of_max, this->new_task_id++));
-      return {threads[index_of_max].back(), true, index_of_max};
+      // A replaced method gets new arguments.
+      if (constructor == &this->constructors[task.constructor]) {
+        return {this->AddTask(index_of_max, task), true, index_of_max};
+      }
+      return {this->AddTask(index_of_max, *constructor), true, index_of_max};
     }
 
     return {threads[index_of_max].back(), false, index_of_max};
@@ -111,34 +84,9 @@ struct PctStrategy : public BaseStrategyWithThreads<TargetObj, Verifier> {
   TaskWithMetaData NextSchedule() override {
     auto& round_schedule = this->round_schedule;
     auto& threads = this->threads;
-
-    size_t max = std::numeric_limits<size_t>::min();
-    size_t index_of_max = 0;
-    // Have to ignore waiting threads, so can't do it faster than O(n)
-    for (size_t i = 0; i < threads.size(); ++i) {
-      int task_index = this->GetNextTaskInThread(i);
-      // Ignore waiting tasks
-      if (task_index == threads[i].size() ||
-          threads[i][task_index]->IsParked()) {
-        // dual waiting if request finished, but follow up isn't
-        // skip dual tasks that already have finished the request
-        // section(follow-up will be executed in another task, so we can't
-        // resume)
-        continue;
-      }
-
-      if (max <= priorities[i]) {
-        max = priorities[i];
-        index_of_max = i;
-      }
-    }
-    // Check whether the priority change is required
-    current_schedule_length++;
-    for (size_t i = 0; i < priority_change_points.size(); ++i) {
-      if (current_schedule_length == priority_change_points[i]) {
-        priorities[index_of_max] = current_depth - i;
-      }
-    }
+    this->UpdateRunnable(RunnableMode::kSchedule);
+    size_t index_of_max = PickMaxPriority();
+    this->OnPicked(index_of_max);
 
     // Picked thread is `index_of_max`
     int next_task_index = this->GetNextTaskInThread(index_of_max);
@@ -148,6 +96,33 @@ struct PctStrategy : public BaseStrategyWithThreads<TargetObj, Verifier> {
                             index_of_max};
   }
 
+  // The priorities change only at the change points, so until the next one
+  // the thread with the highest priority is picked again.
+  size_t GetYieldBudget() override {
+    size_t budget = std::numeric_limits<size_t>::max();
+    for (auto point : priority_change_points) {
+      if (point > current_schedule_length) {
+        budget = std::min(budget, point - current_schedule_length - 1);
+      }
+    }
+    return budget;
+  }
+
+  void OnYieldsSpent(size_t yields) override {
+    current_schedule_length += yields;
+  }
+
+  // The depth grows with the round index, and the estimate of the schedule
+  // length doesn't depend on the previous rounds, so a round is replayed by
+  // its index and seed.
+  void SeedRound(size_t round, uint64_t round_seed) override {
+    rng.seed(round_seed);
+    this->scenario.Reset(this->constructors, threads_count, max_tasks,
+                         round_seed);
+    current_depth = std::min(round + 1, kMaxDepth);
+    PrepareForDepth(current_depth, EstimateScheduleLength());
+  }
+
   void StartNextRound() override {
     this->new_task_id = 0;
     //    log() << "depth: " << current_depth << "\n";
@@ -160,37 +135,78 @@ struct PctStrategy : public BaseStrategyWithThreads<TargetObj, Verifier> {
       }
       thread = StableVector<Task>();
     }
+    this->ClearTaskTable();
+    this->arena.Clear();
     //this->state.Reset();
 
-    UpdateStatistics();
+    current_schedule_length = 0;
   }
 
   void ResetCurrentRound() override {
     BaseStrategyWithThreads<TargetObj, Verifier>::ResetCurrentRound();
-    UpdateStatistics();
+    current_schedule_length = 0;
+    current_depth = std::min(current_depth + 1, kMaxDepth);
+    PrepareForDepth(current_depth, EstimateScheduleLength());
   }
 
   ~PctStrategy() { this->TerminateTasks(); }
 
- private:
-  void UpdateStatistics() {
-    // Update statistics
-    current_depth++;
-    if (current_depth >= 50) {
-      current_depth = 50;
+ protected:
+  void OnRunnableChanged(size_t thread, bool is_runnable) override {
+    if (is_runnable) {
+      by_priority.emplace(priorities[thread], thread);
+    } else {
+      by_priority.erase({priorities[thread], thread});
     }
-    k_statistics.push_back(current_schedule_length);
-    current_schedule_length = 0;
+  }
+
+ private:
+  using RunnableMode =
+      typename BaseStrategyWithThreads<TargetObj, Verifier>::RunnableMode;
+
+  // Picks the runnable thread with the highest priority and changes its
+  // priority if the step is a change point.
+  size_t PickMaxPriority() {
+    assert(!by_priority.empty() && "all threads are empty or parked");
+    // The last thread wins among the same priorities.
+    size_t index_of_max = by_priority.rbegin()->second;
 
-    // current_depth have been increased
-    size_t new_k = std::reduce(k_statistics.begin(), k_statistics.end()) /
-                   k_statistics.size();
-    log() << "k: " << new_k << "\n";
-    PrepareForDepth(current_depth, new_k);
+    // Check whether the priority change is required
+    current_schedule_length++;
+    for (size_t i = 0; i < priority_change_points.size(); ++i) {
+      if (current_schedule_length == priority_change_points[i]) {
+        by_priority.erase({priorities[index_of_max], index_of_max});
+        priorities[index_of_max] = current_depth - i;
+        by_priority.emplace(priorities[index_of_max], index_of_max);
+      }
+    }
+    return index_of_max;
   }
 
-  std::unordered_set<std::string> CountNames(size_t except_thread) {
-    std::unordered_set<std::string> names;
+  static constexpr size_t kMaxDepth = 50;
+
+  // Picks a task makes on average, the instrumented targets yield at every
+  // shared access.
+  static constexpr size_t kPicksPerTask = 16;
+
+  // Returns the estimate of the length of the schedule.
+  size_t EstimateScheduleLength() const { return max_tasks * kPicksPerTask; }
+
+  // Set of the method ids.
+  struct MethodSet {
+    std::vector<bool> contains;
+    size_t size{};
+
+    void Insert(ltest::MethodId id) {
+      if (!contains[id]) {
+        contains[id] = true;
+        ++size;
+      }
+    }
+  };
+
+  MethodSet CountMethods(size_t except_thread) {
+    MethodSet methods{std::vector<bool>(ltest::GetMethodsCount())};
 
     for (size_t i = 0; i < this->threads.size(); ++i) {
       auto& thread = this->threads[i];
@@ -199,34 +215,39 @@ struct PctStrategy : public BaseStrategyWithThreads<TargetObj, Verifier> {
       }
 
       auto& task = thread.back();
-      names.insert(std::string{task->GetName()});
+      methods.Insert(task->GetMethodId());
     }
 
-    return names;
+    return methods;
   }
 
   void PrepareForDepth(size_t depth, size_t k) {
-    // Generates priorities
+    // Generates priorities, the runnable threads are ordered by the new ones
+    // at the next pick.
+    by_priority.clear();
     priorities = std::vector<size_t>(threads_count);
     for (size_t i = 0; i < priorities.size(); ++i) {
       priorities[i] = current_depth + i;
     }
     std::shuffle(priorities.begin(), priorities.end(), rng);
 
-    // Generates priority_change_points
+    // Generates priority_change_points, there are none if the length of the
+    // schedule is unknown.
     auto k_distribution =
         std::uniform_int_distribution<std::mt19937::result_type>(1, k);
-    priority_change_points = std::vector<size_t>(depth - 1);
-    for (size_t i = 0; i < depth - 1; ++i) {
+    priority_change_points = std::vector<size_t>(k == 0 ? 0 : depth - 1);
+    for (size_t i = 0; i < priority_change_points.size(); ++i) {
       priority_change_points[i] = k_distribution(rng);
     }
   }
 
-  std::vector<size_t> k_statistics;
   size_t threads_count;
+  size_t max_tasks;
   size_t current_depth;
   size_t current_schedule_length;
   std::vector<size_t> priorities;
+  // Runnable threads ordered by {priority, thread}.
+  std::set<std::pair<size_t, size_t>> by_priority;
   std::vector<size_t> priority_change_points;
   // Strategy struct is the owner of all tasks, and all
   // references can't be invalidated before the end of the round,
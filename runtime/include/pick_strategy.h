@@ -1,24 +1,30 @@
 
 #pragma once
 #include <algorithm>
+#include <numeric>
+#include <optional>
 #include <random>
+#include <vector>
 
 #include "scheduler.h"
 
-template <typename TargetObj, StrategyVerifier Verifier>
+// PickStrategy generates the rounds picking the threads with the policy of
+// Derived (CRTP), which implements:
+//   size_t Pick() picks one of the runnable threads to continue the round
+//     generation;
+//   size_t PickSchedule() picks one of the runnable threads to continue the
+//     saved round.
+// The picks are called on every step, so they are not virtual.
+template <typename TargetObj, StrategyVerifier Verifier, typename Derived>
 struct PickStrategy : public BaseStrategyWithThreads<TargetObj, Verifier> {
-  virtual size_t Pick() = 0;
-
-  virtual size_t PickSchedule() = 0;
-
-  explicit PickStrategy(size_t threads_count,
-                        std::vector<TaskBuilder> constructors)
-      : next_task(0), threads_count(threads_count) {
+  PickStrategy(size_t threads_count, std::vector<TaskBuilder> constructors,
+               size_t max_tasks)
+      : next_task(0), threads_count(threads_count), max_tasks(max_tasks) {
     this->constructors = std::move(constructors);
     this->round_schedule.resize(threads_count, -1);
+    constructors_order.resize(this->constructors.size());
+    std::iota(constructors_order.begin(), constructors_order.end(), 0);
 
-    std::random_device dev;
-    rng = std::mt19937(dev());
     this->constructors_distribution =
         std::uniform_int_distribution<std::mt19937::result_type>(
             0, this->constructors.size() - 1);
@@ -33,33 +39,36 @@ struct PickStrategy : public BaseStrategyWithThreads<TargetObj, Verifier> {
   // is equal to the max_tasks the finished task will be returned
   TaskWithMetaData Next() override {
     auto& threads = this->threads;
-    auto current_thread = Pick();
+    this->UpdateRunnable(RunnableMode::kGenerate);
+    auto current_thread = static_cast<Derived*>(this)->Pick();
+    this->OnPicked(current_thread);
     debug(stderr, "Picked thread: %zu\n", current_thread);
 
     // it's the first task if the queue is empty
     if (threads[current_thread].empty() ||
         threads[current_thread].back()->IsReturned()) {
-      // a task has finished or the queue is empty, so we add a new task
-      std::shuffle(this->constructors.begin(), this->constructors.end(), rng);
-      size_t verified_constructor = -1;
-      for (size_t i = 0; i < this->constructors.size(); ++i) {
-        TaskBuilder constructor = this->constructors.at(i);
-        CreatedTaskMetaData next_task = {constructor.GetName(), true,
-                                         current_thread};
-        if (this->sched_checker.Verify(next_task)) {
+      // a task has finished or the queue is empty, so we add the next task
+      // of the scenario of the thread, or the first method in a random order
+      // the verifier allows if it doesn't allow that one
+      const auto& task = this->scenario.Next(current_thread);
+      if (IsAllowed(task.constructor, current_thread)) {
+        return {this->AddTask(current_thread, task), true, current_thread};
+      }
+      std::shuffle(constructors_order.begin(), constructors_order.end(), rng);
+      std::optional<size_t> verified_constructor;
+      for (size_t i : constructors_order) {
+        if (IsAllowed(i, current_thread)) {
           verified_constructor = i;
           break;
         }
       }
-      if (verified_constructor == -1) {
-        assert(false && "Oops, possible deadlock or incorrect verifier\n");
-      }
-      threads[current_thread].emplace_back(
-          this->constructors[verified_constructor].Build(
-              &this->state, current_thread, this->new_task_id++));
-      TaskWithMetaData task{threads[current_thread].back(), true,
-                            current_thread};
-      return task;
+      assert(verified_constructor.has_value() &&
+             "Oops, possible deadlock or incorrect verifier\n");
+      // The replacement depends on the interleaving, so its arguments are
+      // generated now.
+      const auto& constructor = this->constructors[*verified_constructor];
+      return {this->AddTask(current_thread, constructor), true,
+              current_thread};
     }
 
     return {threads[current_thread].back(), false, current_thread};
@@ -67,7 +76,9 @@ struct PickStrategy : public BaseStrategyWithThreads<TargetObj, Verifier> {
 
   TaskWithMetaData NextSchedule() override {
     auto& round_schedule = this->round_schedule;
-    size_t current_thread = PickSchedule();
+    this->UpdateRunnable(RunnableMode::kSchedule);
+    size_t current_thread = static_cast<Derived*>(this)->PickSchedule();
+    this->OnPicked(current_thread);
     int next_task_index = this->GetNextTaskInThread(current_thread);
     bool is_new = round_schedule[current_thread] != next_task_index;
 
@@ -76,6 +87,13 @@ struct PickStrategy : public BaseStrategyWithThreads<TargetObj, Verifier> {
                             is_new, current_thread};
   }
 
+  void SeedRound(size_t round, uint64_t round_seed) override {
+    rng.seed(round_seed);
+    std::iota(constructors_order.begin(), constructors_order.end(), 0);
+    this->scenario.Reset(this->constructors, threads_count, max_tasks,
+                         round_seed);
+  }
+
   void StartNextRound() override {
     this->new_task_id = 0;
 
@@ -86,6 +104,8 @@ struct PickStrategy : public BaseStrategyWithThreads<TargetObj, Verifier> {
         thread.pop_back();
       }
     }
+    this->ClearTaskTable();
+    this->arena.Clear();
 
     // Reinitial target as we start from the beginning.
     //this->state.Reset();
@@ -94,7 +114,21 @@ struct PickStrategy : public BaseStrategyWithThreads<TargetObj, Verifier> {
   ~PickStrategy() { this->TerminateTasks(); }
 
  protected:
+  using RunnableMode =
+      typename BaseStrategyWithThreads<TargetObj, Verifier>::RunnableMode;
+
+  bool IsAllowed(size_t constructor, size_t thread) {
+    CreatedTaskMetaData task = {this->constructors[constructor].GetMethodId(),
+                                true, thread};
+    return this->sched_checker.Verify(task);
+  }
+
   size_t next_task = 0;
   size_t threads_count;
+  // A thread creates at most max_tasks tasks in a round, see Scenario.
+  size_t max_tasks;
   std::mt19937 rng;
+  // Order the constructors are tried in, it's shuffled for each new task and
+  // reset for each round.
+  std::vector<size_t> constructors_order;
 };
@@ -44,7 +44,7 @@ struct PrettyPrinter {
 
     auto print_separator = [&out, this, cell_width]() {
       out << "*";
-      for (int i = 0; i < threads_num; ++i) {
+      for (size_t i = 0; i < threads_num; ++i) {
         for (int j = 0; j < cell_width; ++j) {
           out << "-";
         }
@@ -62,7 +62,7 @@ struct PrettyPrinter {
     print_separator();
     // Header.
     out << "|";
-    for (int i = 0; i < threads_num; ++i) {
+    for (size_t i = 0; i < threads_num; ++i) {
       int rest = cell_width - 1 /*T*/ - to_string(i).size();
       print_spaces(rest / 2);
       out << "T" << i;
@@ -95,7 +95,7 @@ struct PrettyPrinter {
         fp.Out(std::string{task->GetName()});
         fp.Out("(");
         const auto& args = task->GetStrArgs();
-        for (int i = 0; i < args.size(); ++i) {
+        for (size_t i = 0; i < args.size(); ++i) {
           if (i > 0) {
             fp.Out(", ");
           }
@@ -110,7 +110,7 @@ struct PrettyPrinter {
       print_spaces(fp.rest);
       out << "|";
 
-      for (int j = 0; j < threads_num - num - 1; ++j) {
+      for (size_t j = num + 1; j < threads_num; ++j) {
         print_empty_cell();
       }
       out << "\n";
@@ -126,7 +126,7 @@ struct PrettyPrinter {
 
     auto print_separator = [&out, this, cell_width]() {
       out << "*";
-      for (int i = 0; i < threads_num; ++i) {
+      for (size_t i = 0; i < threads_num; ++i) {
         for (int j = 0; j < cell_width; ++j) {
           out << "-";
         }
@@ -147,7 +147,7 @@ struct PrettyPrinter {
     // Header.
     print_spaces(spaces);
     out << "|";
-    for (int i = 0; i < threads_num; ++i) {
+    for (size_t i = 0; i < threads_num; ++i) {
       int rest = cell_width - 1 /*T*/ - to_string(i).size();
       print_spaces(rest / 2);
       out << "T" << i;
@@ -172,7 +172,7 @@ struct PrettyPrinter {
       FitPrinter fp{out, cell_width};
       if (i.second.index() == 0) {
         auto act = std::get<0>(i.second);
-        auto base = act.get().get();
+        auto base = act.get();
         if (index.find(base) == index.end()) {
           int sz = index.size();
           index[base] = sz;
@@ -189,7 +189,7 @@ struct PrettyPrinter {
         fp.Out(std::string{act.get()->GetName()});
         fp.Out("(");
         const auto& args = act.get()->GetStrArgs();
-        for (int i = 0; i < args.size(); ++i) {
+        for (size_t i = 0; i < args.size(); ++i) {
           if (i > 0) {
             fp.Out(", ");
           }
@@ -224,7 +224,7 @@ struct PrettyPrinter {
       print_spaces(fp.rest);
       out << "|";
 
-      for (int j = 0; j < threads_num - num - 1; ++j) {
+      for (size_t j = num + 1; j < threads_num; ++j) {
         print_empty_cell();
       }
       out << "\n";
@@ -1,84 +1,78 @@
 #pragma once
+#include <algorithm>
+#include <functional>
+#include <limits>
 #include <random>
 #include <utility>
 #include <vector>
 
+#include "fenwick_tree.h"
 #include "lib.h"
 #include "pick_strategy.h"
 
 // Allows a random thread to work.
 // Randoms new task.
 template <typename TargetObj, StrategyVerifier Verifier>
-struct RandomStrategy : PickStrategy<TargetObj, Verifier> {
-  explicit RandomStrategy(size_t threads_count,
-                          std::vector<TaskBuilder> constructors,
-                          std::vector<int> weights)
-      : PickStrategy<TargetObj, Verifier>{threads_count,
-                                          std::move(constructors)},
-        weights{std::move(weights)} {}
+struct RandomStrategy final
+    : PickStrategy<TargetObj, Verifier, RandomStrategy<TargetObj, Verifier>> {
+  RandomStrategy(size_t threads_count, std::vector<TaskBuilder> constructors,
+                 size_t max_tasks, std::vector<int> weights)
+      : PickStrategy<TargetObj, Verifier, RandomStrategy>{
+            threads_count, std::move(constructors), max_tasks},
+        weights{std::move(weights)} {
+    is_uniform = std::adjacent_find(this->weights.begin(), this->weights.end(),
+                                    std::not_equal_to<>{}) ==
+                 this->weights.end();
+    runnable_weights.Reset(threads_count);
+  }
 
-  size_t Pick() override {
-    pick_weights.clear();
-    auto &threads = PickStrategy<TargetObj, Verifier>::threads;
-    for (size_t i = 0; i < threads.size(); ++i) {
-      if (!threads[i].empty() &&
-      (threads[i].back()->IsParked() || threads[i].back()->IsBlocked())) {
-        continue;
-      }
-      pick_weights.push_back(weights[i]);
-    }
+  size_t Pick() { return PickRunnable(); }
 
-    assert(!pick_weights.empty() && "deadlock");
+  size_t PickSchedule() { return PickRunnable(); }
 
-    auto thread_distribution =
-        std::discrete_distribution<>(pick_weights.begin(), pick_weights.end());
-    auto num = thread_distribution(PickStrategy<TargetObj, Verifier>::rng);
-    for (size_t i = 0; i < threads.size(); ++i) {
-      if (!threads[i].empty() &&
-          (threads[i].back()->IsParked() || threads[i].back()->IsBlocked())) {
-        continue;
-      }
-      if (num == 0) {
-        return i;
-      }
-      num--;
+  // Picks are independent, so the number of the picks of the same thread in
+  // a row is geometric.
+  size_t GetYieldBudget() override {
+    if (repeat_probability >= 1) {
+      return std::numeric_limits<size_t>::max();
     }
-    assert(false && "Cannot pick thread to continue round generation");
+    return std::geometric_distribution<size_t>(1 - repeat_probability)(
+        this->rng);
   }
 
-  size_t PickSchedule() override {
-    pick_weights.clear();
-    auto &threads = this->threads;
-
-    for (size_t i = 0; i < threads.size(); ++i) {
-      int task_index = this->GetNextTaskInThread(i);
-      if (task_index == threads[i].size() ||
-          threads[i][task_index]->IsParked()) {
-        continue;
-      }
-      pick_weights.push_back(weights[i]);
+ protected:
+  void OnRunnableChanged(size_t thread, bool is_runnable) override {
+    if (!is_uniform) {
+      runnable_weights.Set(thread, is_runnable ? weights[thread] : 0);
     }
+  }
 
-    assert(!pick_weights.empty() && "deadlock");
+ private:
+  // Picks a runnable thread with the probability proportional to its weight.
+  size_t PickRunnable() {
+    auto &runnable = this->runnable;
+    assert(!runnable.Empty() && "deadlock");
 
-    auto thread_distribution =
-        std::discrete_distribution<>(pick_weights.begin(), pick_weights.end());
-    auto num = thread_distribution(this->rng);
-    for (size_t i = 0; i < threads.size(); ++i) {
-      int task_index = this->GetNextTaskInThread(i);
-      if (task_index == threads[i].size() ||
-          threads[i][task_index]->IsParked()) {
-        continue;
-      }
-      if (num == 0) {
-        return i;
-      }
-      num--;
+    if (is_uniform || runnable_weights.Total() == 0) {
+      auto num = std::uniform_int_distribution<size_t>(
+          0, runnable.Size() - 1)(this->rng);
+      repeat_probability = 1.0 / runnable.Size();
+      return runnable.Select(num);
     }
-    assert(false && "Cannot pick thread to continue round scheduling");
+
+    auto total = runnable_weights.Total();
+    auto value = std::uniform_int_distribution<long>(0, total - 1)(this->rng);
+    auto thread = runnable_weights.Find(value);
+    repeat_probability =
+        static_cast<double>(runnable_weights.Get(thread)) / total;
+    return thread;
   }
 
- private:
   std::vector<int> weights;
-  std::vector<int> pick_weights;
+  // Are all weights the same, then the runnable threads are picked uniformly.
+  bool is_uniform;
+  // Weights of the runnable threads, the others have zero weights.
+  ltest::FenwickTree runnable_weights;
+  // Probability to pick the last picked thread again.
+  double repeat_probability{};
 };
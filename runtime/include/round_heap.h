@@ -0,0 +1,125 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace ltest {
+
+// RoundHeap is a bump allocator for the memory the target allocates during
+// a round. While a task runs, operator new of the thread takes memory from
+// the heap and operator delete of it does nothing, and the whole heap is
+// rewound when the round is reset, see ResetTarget(). The heap reserves
+// address space once and falls back to malloc when it's full.
+// Memory allocated by a task must not be used after the rewind, so the
+// runtime copies the return values of the tasks out of the heap.
+// Only operator new and delete are routed, malloc is not: replacing it would
+// also take the allocations of libc, Boost.Context and the sanitizers, which
+// intercept malloc themselves. The memory the targets take from malloc
+// directly is not rewound, they have to free it.
+class RoundHeap {
+ public:
+  explicit RoundHeap(size_t capacity = kDefaultCapacity);
+  RoundHeap(const RoundHeap&) = delete;
+  RoundHeap& operator=(const RoundHeap&) = delete;
+  ~RoundHeap();
+
+  // Returns nullptr if the heap is full.
+  void* Allocate(size_t size, size_t alignment) {
+    auto begin = (used + alignment - 1) & ~(alignment - 1);
+    if (begin + size > capacity) {
+      return nullptr;
+    }
+    used = begin + size;
+    return base + begin;
+  }
+
+  bool Owns(const void* ptr) const {
+    auto p = static_cast<const std::byte*>(ptr);
+    return base <= p && p < base + capacity;
+  }
+
+  // Frees all memory allocated from the heap.
+  void Rewind() { used = 0; }
+
+  // Is true while the allocations of the thread go to the heap.
+  bool active{};
+
+ private:
+  static constexpr size_t kDefaultCapacity = size_t{1} << 30;
+
+  std::byte* base;
+  size_t capacity;
+  size_t used{};
+};
+
+// Heap of the rounds explored by the current thread, nullptr if the
+// allocations are not routed to a round heap.
+extern constinit thread_local RoundHeap* round_heap;
+
+// Installs the heap for the current thread while the guard is alive.
+class RoundHeapGuard {
+ public:
+  explicit RoundHeapGuard(RoundHeap* heap)
+      : prev(std::exchange(round_heap, heap)) {}
+  RoundHeapGuard(const RoundHeapGuard&) = delete;
+  RoundHeapGuard& operator=(const RoundHeapGuard&) = delete;
+  ~RoundHeapGuard() { round_heap = prev; }
+
+ private:
+  RoundHeap* prev;
+};
+
+// Routes the allocations of the thread to its round heap (or back to
+// malloc) while the scope is alive.
+class RoundHeapScope {
+ public:
+  explicit RoundHeapScope(bool active)
+      : heap(round_heap),
+        prev(heap != nullptr && std::exchange(heap->active, active)) {}
+  RoundHeapScope(const RoundHeapScope&) = delete;
+  RoundHeapScope& operator=(const RoundHeapScope&) = delete;
+  ~RoundHeapScope() {
+    if (heap != nullptr) {
+      heap->active = prev;
+    }
+  }
+
+ private:
+  RoundHeap* heap;
+  bool prev;
+};
+
+// Prepares the target object for the next round. Without the round heap
+// TargetObj::Reset() is called, the targets without it are created again in
+// place. With the round heap, the heap is rewound if `rewind` and the object
+// is created again with its memory in the heap, so the reset doesn't depend
+// on the size of the object. `in_heap` tells if the object was created in
+// the heap. An object is destroyed before it's created again only if its
+// memory is not in the heap and `rewind` is set, otherwise the tasks may
+// still use it.
+template <typename T>
+void ResetTarget(T& target, bool& in_heap, bool rewind) {
+  if (round_heap == nullptr) {
+    if constexpr (requires { target.Reset(); }) {
+      target.Reset();
+    } else {
+      if (rewind) {
+        std::destroy_at(&target);
+      }
+      std::construct_at(&target);
+    }
+    return;
+  }
+
+  if (!in_heap && rewind) {
+    std::destroy_at(&target);
+  }
+  in_heap = true;
+  if (rewind) {
+    round_heap->Rewind();
+  }
+  RoundHeapScope scope{true};
+  std::construct_at(&target);
+}
+
+}  // namespace ltest
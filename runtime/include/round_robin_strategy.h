@@ -1,43 +1,46 @@
 #pragma once
 
+#include <limits>
 #include <utility>
 
 #include "pick_strategy.h"
 
 template <typename TargetObj, StrategyVerifier Verifier>
-struct RoundRobinStrategy : PickStrategy<TargetObj, Verifier> {
-  explicit RoundRobinStrategy(size_t threads_count,
-                              std::vector<TaskBuilder> constructors)
+struct RoundRobinStrategy final
+    : PickStrategy<TargetObj, Verifier,
+                   RoundRobinStrategy<TargetObj, Verifier>> {
+  RoundRobinStrategy(size_t threads_count,
+                     std::vector<TaskBuilder> constructors, size_t max_tasks)
       : next_task{0},
-        PickStrategy<TargetObj, Verifier>{threads_count,
-                                          std::move(constructors)} {}
-
-  size_t Pick() override {
-    auto &threads = PickStrategy<TargetObj, Verifier>::threads;
-    for (size_t attempt = 0; attempt < threads.size(); ++attempt) {
-      auto cur = (next_task++) % threads.size();
-      if (!threads[cur].empty() && (threads[cur].back()->IsParked() ||
-                                    threads[cur].back()->IsBlocked())) {
-        continue;
-      }
-      return cur;
-    }
-    assert(false && "deadlock");
+        PickStrategy<TargetObj, Verifier, RoundRobinStrategy>{
+            threads_count, std::move(constructors), max_tasks} {}
+
+  // The rounds start from different threads.
+  void SeedRound(size_t round, uint64_t round_seed) override {
+    PickStrategy<TargetObj, Verifier, RoundRobinStrategy>::SeedRound(
+        round, round_seed);
+    next_task = round;
+  }
+
+  size_t Pick() { return PickNext(); }
+
+  size_t PickSchedule() { return PickNext(); }
+
+  // Picks the first runnable thread after the previous pick.
+  size_t PickNext() {
+    auto &runnable = this->runnable;
+    assert(!runnable.Empty() && "deadlock");
+    auto cur = runnable.NextCyclic(next_task % this->threads.size());
+    next_task = cur + 1;
+    return cur;
   }
 
-  size_t PickSchedule() override {
-    auto &threads = this->threads;
-    for (size_t attempt = 0; attempt < threads.size(); ++attempt) {
-      auto cur = (next_task++) % threads.size();
-      int task_index = this->GetNextTaskInThread(cur);
-
-      if (task_index == threads[cur].size() ||
-          threads[cur][task_index]->IsParked()) {
-        continue;
-      }
-      return cur;
-    }
-    assert(false && "deadlock");
+  // A thread is picked again only if it's the only runnable one. Another
+  // thread becomes runnable at a futex call, which always switches, or at
+  // Token::Unpark(), which drops the budget.
+  size_t GetYieldBudget() override {
+    return this->runnable.Size() == 1 ? std::numeric_limits<size_t>::max()
+                                      : 0;
   }
 
   size_t next_task;
@@ -0,0 +1,71 @@
+#pragma once
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "lib.h"
+
+namespace ltest {
+
+// Scenario is the sequence of the tasks (the methods with their arguments)
+// each thread creates in a round. It's generated when the round is seeded
+// and depends only on the round seed and the thread, not on the
+// interleaving, so the strategy reads the next task of the thread instead of
+// drawing it when it creates a task.
+class Scenario {
+ public:
+  struct Entry {
+    // Index of the constructor of the task.
+    size_t constructor;
+    // See TaskBuilder::GenArgs().
+    ValueWrapper args;
+  };
+
+  // Generates tasks_count tasks for each thread, a thread never creates more
+  // in a round. The methods and the arguments of a thread are drawn from its
+  // own generator.
+  void Reset(const std::vector<TaskBuilder>& constructors,
+             size_t threads_count, size_t tasks_count, uint64_t seed) {
+    assert(!constructors.empty());
+    std::uniform_int_distribution<size_t> distribution(
+        0, constructors.size() - 1);
+    // The generators of the arguments draw from the runtime generator, so
+    // it's replaced with the one of the thread meanwhile.
+    auto& runtime_rng = GetRuntimeContext().rng;
+    threads.resize(threads_count);
+    for (size_t i = 0; i < threads_count; ++i) {
+      auto& thread = threads[i];
+      thread.tasks.clear();
+      thread.next = 0;
+      std::mt19937 rng(MixSeed(seed + i));
+      std::swap(runtime_rng, rng);
+      for (size_t j = 0; j < tasks_count; ++j) {
+        auto constructor = distribution(runtime_rng);
+        thread.tasks.push_back(
+            {constructor, constructors[constructor].GenArgs(i)});
+      }
+      std::swap(runtime_rng, rng);
+    }
+  }
+
+  // Returns the next task of the thread.
+  const Entry& Next(size_t thread) {
+    auto& scenario = threads[thread];
+    assert(scenario.next < scenario.tasks.size());
+    return scenario.tasks[scenario.next++];
+  }
+
+ private:
+  struct ThreadScenario {
+    std::vector<Entry> tasks;
+    // Index of the next task.
+    size_t next{};
+  };
+
+  std::vector<ThreadScenario> threads;
+};
+
+}  // namespace ltest
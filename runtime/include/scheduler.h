@@ -9,19 +9,25 @@
 #include <string_view>
 #include <utility>
 
+#include "fork_checkpoints.h"
 #include "lib.h"
 #include "lincheck.h"
 #include "logger.h"
 #include "minimization.h"
 #include "minimization_smart.h"
 #include "pretty_print.h"
+#include "round_heap.h"
+#include "scenario.h"
 #include "scheduler_fwd.h"
 #include "stable_vector.h"
+#include "task_terminator.h"
+#include "thread_set.h"
+#include "visited_states.h"
 
 /// Generated by some strategy task,
 /// that may be not executed due to constraints of data structure
 struct CreatedTaskMetaData {
-  std::string name;
+  ltest::MethodId method_id;
   bool is_new;
   size_t thread_id;
 };
@@ -39,7 +45,7 @@ struct TaskWithMetaData {
 template <typename T>
 concept StrategyVerifier = requires(T a) {
   {
-    a.Verify(CreatedTaskMetaData(string(), bool(), int()))
+    a.Verify(CreatedTaskMetaData(ltest::MethodId(), bool(), int()))
   } -> std::same_as<bool>;
   {
     a.OnFinished(TaskWithMetaData(std::declval<Task&>(), bool(), int()))
@@ -61,6 +67,20 @@ struct Strategy {
   // round replaying functionality)
   virtual TaskWithMetaData NextSchedule() = 0;
 
+  // Seeds the random choices of the round, it's called before the round is
+  // generated. `round` is the index of the round, see ltest::GetRoundSeed().
+  virtual void SeedRound(size_t /*round*/, uint64_t /*round_seed*/) {}
+
+  // Returns how many times in a row after the last `Next` or `NextSchedule`
+  // the strategy would pick the same thread again, so its task can make that
+  // many yields without switching to the scheduler, see CoroYieldFast().
+  // SIZE_MAX means the task may run until it returns or blocks.
+  virtual size_t GetYieldBudget() { return 0; }
+
+  // Called when the task made `yields` yields of its budget, as if it was
+  // picked `yields` more times.
+  virtual void OnYieldsSpent(size_t /*yields*/) {}
+
   // Returns { task, its thread id } (TODO: make it `const` method)
   virtual std::optional<std::tuple<Task&, int>> GetTask(int task_id) = 0;
 
@@ -70,15 +90,22 @@ struct Strategy {
 
   // Returns true if the task with the given id is marked as removed
   bool IsTaskRemoved(int task_id) const {
-    return removed_tasks.contains(task_id);
+    return task_id < static_cast<int>(removed_tasks.size()) &&
+           removed_tasks[task_id];
   }
 
   // Marks or demarks task as removed
   void SetTaskRemoved(int task_id, bool is_removed) {
-    if (is_removed)
-      removed_tasks.insert(task_id);
-    else
-      removed_tasks.erase(task_id);
+    if (task_id >= static_cast<int>(removed_tasks.size())) {
+      if (!is_removed) {
+        return;
+      }
+      removed_tasks.resize(task_id + 1);
+    }
+    if (removed_tasks[task_id] != is_removed) {
+      removed_tasks[task_id] = is_removed;
+      removed_count += is_removed ? 1 : -1;
+    }
   }
 
   // Removes all tasks to start a new round.
@@ -111,8 +138,11 @@ struct Strategy {
 
   // id of next generated task
   int new_task_id = 0;
-  // stores task ids that are removed during the round minimization
-  std::unordered_set<int> removed_tasks;
+  // marks the task ids that are removed during the round minimization, the
+  // ids are dense in a round (see new_task_id), so it's indexed by them
+  std::vector<bool> removed_tasks;
+  // number of the marked tasks in removed_tasks
+  int removed_count = 0;
   // when generated round is explored this vector stores indexes of tasks
   // that will be invoked next in each thread
   std::vector<int> round_schedule;
@@ -121,22 +151,12 @@ struct Strategy {
 template <typename TargetObj, StrategyVerifier Verifier>
 struct BaseStrategyWithThreads : public Strategy {
   std::optional<std::tuple<Task&, int>> GetTask(int task_id) override {
-    // TODO: can this be optimized?
-    int thread_id = 0;
-    for (auto& thread : threads) {
-      size_t tasks = thread.size();
-
-      for (size_t i = 0; i < tasks; ++i) {
-        Task& task = thread[i];
-        if (task->GetId() == task_id) {
-          std::tuple<Task&, int> result = {task, thread_id};
-          return result;
-        }
-      }
-
-      thread_id++;
+    if (task_id < 0 || task_id >= static_cast<int>(task_slots.size())) {
+      return std::nullopt;
     }
-    return std::nullopt;
+    auto [thread_id, index] = task_slots[task_id];
+    std::tuple<Task&, int> result = {threads[thread_id][index], thread_id};
+    return result;
   }
 
   const std::vector<StableVector<Task>>& GetTasks() const override {
@@ -157,25 +177,10 @@ struct BaseStrategyWithThreads : public Strategy {
   }
 
   int GetValidTasksCount() const override {
-    int non_removed_tasks = 0;
-    for (auto& thread : threads) {
-      for (size_t i = 0; i < thread.size(); ++i) {
-        auto& task = thread[i];
-        if (!IsTaskRemoved(task->GetId())) {
-          non_removed_tasks++;
-        }
-      }
-    }
-    return non_removed_tasks;
+    return GetTotalTasksCount() - removed_count;
   }
 
-  int GetTotalTasksCount() const override {
-    int total_tasks = 0;
-    for (auto& thread : threads) {
-      total_tasks += thread.size();
-    }
-    return total_tasks;
-  }
+  int GetTotalTasksCount() const override { return task_slots.size(); }
 
   int GetThreadsCount() const override { return threads.size(); }
 
@@ -184,93 +189,197 @@ struct BaseStrategyWithThreads : public Strategy {
   }
 
  protected:
-  // Terminates all running tasks.
-  // We do it in a dangerous way: in random order.
-  // Actually, we assume obstruction free here.
-  // TODO: for locks we need to figure out how to properly terminate: see
-  // https://github.com/ITMO-PTDC-Team/LTest/issues/13
+  // Terminates all running tasks, see ltest::TaskTerminator.
   void TerminateTasks() {
     auto& round_schedule = this->round_schedule;
     assert(round_schedule.size() == this->threads.size() &&
            "sizes expected to be the same");
     round_schedule.assign(round_schedule.size(), -1);
+    task_cursors.assign(threads.size(), 0);
 
-    std::vector<size_t> task_indexes(this->threads.size(), 0);
-    bool has_nonterminated_threads = true;
+    for (auto& thread : this->threads) {
+      terminator.AddThread(thread);
+    }
+    terminator.Terminate([this] {
+      ltest::ResetTarget(state, state_in_round_heap, false);
+    });
+    runnable_mode = RunnableMode::kNone;
 
-    while (has_nonterminated_threads) {
-      has_nonterminated_threads = false;
+    this->sched_checker.Reset();
+    ltest::ResetTarget(state, state_in_round_heap, true);
+  }
 
-      for (size_t thread_index = 0; thread_index < this->threads.size();
-           ++thread_index) {
-        auto& thread = this->threads[thread_index];
-        auto& task_index = task_indexes[thread_index];
+  // Builds the next task of the round in the thread and remembers where it
+  // is, see GetTask().
+  Task& AddTask(size_t thread, const TaskBuilder& constructor,
+                const ValueWrapper& args) {
+    int task_id = new_task_id++;
+    assert(task_id == static_cast<int>(task_slots.size()) &&
+           "task ids expected to be dense");
+    auto& tasks = threads[thread];
+    tasks.emplace_back(constructor.Build(arena, &state, args, task_id));
+    task_slots.push_back({thread, tasks.size() - 1});
+    return tasks.back();
+  }
 
-        // find first non-finished task in the thread
-        while (task_index < thread.size() && thread[task_index]->IsReturned()) {
-          task_index++;
-        }
+  // Builds the task with new arguments.
+  Task& AddTask(size_t thread, const TaskBuilder& constructor) {
+    return AddTask(thread, constructor, constructor.GenArgs(thread));
+  }
 
-        if (task_index < thread.size()) {
-          auto& task = thread[task_index];
-
-          // if task is blocked and it is the last one, then just increment the
-          // task index
-          if (task->IsBlocked()) {
-            assert(task_index == thread.size() - 1 &&
-                   "Trying to terminate blocked task, which is not last in the "
-                   "thread.");
-            if (task_index == thread.size() - 1) {
-              task_index++;
-            }
-          } else {
-            has_nonterminated_threads = true;
-            // do a single step in this task
-            task->Resume();
-          }
-        }
+  // Builds the task of the scenario.
+  Task& AddTask(size_t thread, const ltest::Scenario::Entry& task) {
+    return AddTask(thread, constructors[task.constructor], task.args);
+  }
+
+  // Forgets the tasks of the round, the threads must be already emptied.
+  void ClearTaskTable() {
+    task_slots.clear();
+    removed_tasks.clear();
+    removed_count = 0;
+  }
+
+  // Which tasks the runnable threads are computed for: the last tasks of the
+  // threads while the round is generated by `Next`, or the next tasks of the
+  // saved round for `NextSchedule`.
+  enum class RunnableMode { kNone, kGenerate, kSchedule };
+
+  // Brings the runnable threads up to date before a pick. Only the running
+  // task can park, block or return, so only the last picked thread is
+  // checked. The waiting threads are checked again after someone has unparked
+  // a token or woken a futex.
+  void UpdateRunnable(RunnableMode mode) {
+    auto wakeups = ltest::GetRuntimeContext().wakeups;
+    if (runnable_mode != mode) {
+      runnable_mode = mode;
+      runnable.ForEach(
+          [this](size_t thread) { OnRunnableChanged(thread, false); });
+      runnable.Reset(threads.size());
+      waiting.Reset(threads.size());
+      for (size_t i = 0; i < threads.size(); ++i) {
+        UpdateThread(i);
       }
+      seen_wakeups = wakeups;
+      last_picked.reset();
+      return;
     }
 
-    this->sched_checker.Reset();
-    state.Reset();
+    if (last_picked.has_value()) {
+      UpdateThread(*last_picked);
+    }
+    if (wakeups != seen_wakeups) {
+      seen_wakeups = wakeups;
+      waiting.ForEach([this](size_t thread) { UpdateThread(thread); });
+    }
   }
 
+  // Remembers the picked thread, UpdateRunnable() checks it.
+  void OnPicked(size_t thread) { last_picked = thread; }
+
+  // Called when the thread becomes runnable or stops being runnable.
+  virtual void OnRunnableChanged(size_t /*thread*/, bool /*is_runnable*/) {}
+
+  // Threads which tasks can be resumed.
+  ltest::ThreadSet runnable;
+
+  // The tasks only return while the round runs and are removed between the
+  // runs, so the scan continues from where the last one stopped.
   int GetNextTaskInThread(int thread_index) const override {
+    assert(task_cursors.size() == threads.size() &&
+           "the round expected to be reset");
     auto& thread = threads[thread_index];
-    int task_index = round_schedule[thread_index];
+    int task_index = std::max({round_schedule[thread_index], 0,
+                               task_cursors[thread_index]});
 
     while (task_index < static_cast<int>(thread.size()) &&
-           (task_index == -1 || thread[task_index].get()->IsReturned() ||
-            IsTaskRemoved(thread[task_index].get()->GetId()))) {
+           (thread[task_index]->IsReturned() ||
+            IsTaskRemoved(thread[task_index]->GetId()))) {
       task_index++;
     }
 
+    task_cursors[thread_index] = task_index;
     return task_index;
   }
 
   Verifier sched_checker{};
   TargetObj state{};
+  // Is the state created in the round heap, see ltest::ResetTarget().
+  bool state_in_round_heap{};
   // Strategy struct is the owner of all tasks, and all
   // references can't be invalidated before the end of the round,
   // so we have to contains all tasks in queues(queue doesn't invalidate the
   // references)
   std::vector<StableVector<Task>> threads;
+  // Where the task with the id is in `threads`, the ids are given out from
+  // zero in a round.
+  struct TaskSlot {
+    size_t thread;
+    size_t index;
+  };
+  std::vector<TaskSlot> task_slots;
+  // For each thread, the tasks from round_schedule up to the cursor are
+  // returned or removed, see GetNextTaskInThread(). The cursors are reset
+  // with the round.
+  mutable std::vector<int> task_cursors;
+  // Memory of the tasks of the round.
+  ltest::TaskArena arena;
+  ltest::TaskTerminator terminator;
   std::vector<TaskBuilder> constructors;
   std::uniform_int_distribution<std::mt19937::result_type>
       constructors_distribution;
+  // Methods of the tasks the threads create in the round.
+  ltest::Scenario scenario;
+
+ private:
+  // Returns the task of the thread the mode resumes, nullptr if there is no.
+  Task GetModeTask(size_t thread) {
+    auto& tasks = threads[thread];
+    if (runnable_mode == RunnableMode::kGenerate) {
+      return tasks.empty() ? nullptr : tasks.back();
+    }
+    size_t task_index = GetNextTaskInThread(thread);
+    return task_index < tasks.size() ? tasks[task_index] : nullptr;
+  }
+
+  void UpdateThread(size_t thread) {
+    auto task = GetModeTask(thread);
+    bool is_waiting =
+        task != nullptr && (task->IsParked() || task->IsBlocked());
+    // While the round is generated, a thread without a task gets a new one.
+    bool is_runnable =
+        !is_waiting &&
+        (task != nullptr || runnable_mode == RunnableMode::kGenerate);
+    if (is_waiting) {
+      waiting.Insert(thread);
+    } else {
+      waiting.Erase(thread);
+    }
+    if (is_runnable ? runnable.Insert(thread) : runnable.Erase(thread)) {
+      OnRunnableChanged(thread, is_runnable);
+    }
+  }
+
+  RunnableMode runnable_mode{RunnableMode::kNone};
+  // Threads which tasks are parked or blocked.
+  ltest::ThreadSet waiting;
+  size_t seen_wakeups{};
+  std::optional<size_t> last_picked;
 };
 
 // StrategyScheduler generates different sequential histories (using Strategy)
-// and then checks them with the ModelChecker
-template <StrategyVerifier Verifier>
+// and then checks them with the ModelChecker.
+// StrategyT is the type of the strategy. With a final strategy class the
+// compiler calls the strategy in the step loop without virtual dispatch and
+// can inline it; Strategy itself is the dynamic fallback.
+template <StrategyVerifier Verifier, typename StrategyT = Strategy>
 struct StrategyScheduler : public SchedulerWithReplay {
   // max_switches represents the maximal count of switches. After this count
   // scheduler will end execution of the Run function
-  StrategyScheduler(Strategy& sched_class, ModelChecker& checker,
+  StrategyScheduler(StrategyT& sched_class, ModelChecker& checker,
                     PrettyPrinter& pretty_printer, size_t max_tasks,
                     size_t max_rounds, bool minimize, size_t exploration_runs,
-                    size_t minimization_runs)
+                    size_t minimization_runs, uint64_t seed = 0,
+                    size_t first_round = 0)
       : strategy(sched_class),
         checker(checker),
         pretty_printer(pretty_printer),
@@ -278,15 +387,24 @@ struct StrategyScheduler : public SchedulerWithReplay {
         max_rounds(max_rounds),
         should_minimize_history(minimize),
         exploration_runs(exploration_runs),
-        minimization_runs(minimization_runs) {}
+        minimization_runs(minimization_runs),
+        seed(seed),
+        first_round(first_round) {}
 
   // Run returns full unliniarizable history if such a history is found. Full
   // history is a history with all events, where each element in the vector is a
   // Resume operation on the corresponding task
   Scheduler::Result Run() override {
     for (size_t i = 0; i < max_rounds; ++i) {
-      log() << "run round: " << i << "\n";
-      debug(stderr, "run round: %d\n", i);
+      if (ltest::GetRuntimeContext().IsStopped()) {
+        break;
+      }
+      auto round = first_round + i;
+      auto round_seed = ltest::GetRoundSeed(seed, round);
+      ltest::GetRuntimeContext().StartRound(round, round_seed);
+      strategy.SeedRound(round, round_seed);
+      log() << "run round: " << round << "\n";
+      debug(stderr, "run round: %d\n", round);
       auto histories = RunRound();
 
       if (histories.has_value()) {
@@ -313,7 +431,7 @@ struct StrategyScheduler : public SchedulerWithReplay {
                 << ", minimization runs: " << minimization_runs << ")...\n";
           Minimize(histories.value(),
                    SmartMinimizor(exploration_runs, minimization_runs,
-                                  pretty_printer));
+                                  pretty_printer, round_seed));
         }
 
         return histories;
@@ -346,7 +464,8 @@ struct StrategyScheduler : public SchedulerWithReplay {
       }
       full_history.emplace_back(next_task);
 
-      next_task->Resume();
+      auto yields = next_task->Resume(strategy.GetYieldBudget());
+      RecordSpentYields(full_history, next_task, yields);
       if (next_task->IsReturned()) {
         finished_tasks++;
         strategy.OnVerifierTaskFinish(t);
@@ -356,7 +475,10 @@ struct StrategyScheduler : public SchedulerWithReplay {
       }
     }
 
-    pretty_printer.PrettyPrint(sequential_history, log());
+    // Arguments are converted to strings only if the history is printed.
+    if (log().verbose) {
+      pretty_printer.PrettyPrint(sequential_history, log());
+    }
 
     if (!checker.Check(sequential_history)) {
       return std::make_pair(full_history, sequential_history);
@@ -382,7 +504,8 @@ struct StrategyScheduler : public SchedulerWithReplay {
         }
         full_history.emplace_back(next_task);
 
-        next_task->Resume();
+        auto yields = next_task->Resume(strategy.GetYieldBudget());
+        RecordSpentYields(full_history, next_task, yields);
         if (next_task->IsReturned()) {
           tasks_to_run--;
 
@@ -402,6 +525,17 @@ struct StrategyScheduler : public SchedulerWithReplay {
     return std::nullopt;
   }
 
+  // Each yield the task made without switching stands for one more pick of
+  // it, so the history is the same as if the task was resumed once per yield.
+  void RecordSpentYields(FullHistory& full_history, Task& task,
+                         size_t yields) {
+    if (yields == 0) {
+      return;
+    }
+    strategy.OnYieldsSpent(yields);
+    full_history.insert(full_history.end(), yields, std::ref(task));
+  }
+
   // Replays current round with specified interleaving
   Result ReplayRound(const std::vector<int>& tasks_ordering) override {
     strategy.ResetCurrentRound();
@@ -409,28 +543,27 @@ struct StrategyScheduler : public SchedulerWithReplay {
     // History of invoke and response events which is required for the checker
     FullHistory full_history;
     SeqHistory sequential_history;
+    // The task ids of the round are [0, total tasks), so the tables are
+    // indexed by them.
     // TODO: `IsRunning` field might be added to `Task` instead
-    std::unordered_set<int> started_tasks;
-    std::unordered_map<int, int>
-        resumes_count;  // task id -> number of appearences in `tasks_ordering`
+    int total_tasks = strategy.GetTotalTasksCount();
+    std::vector<bool> started_tasks(total_tasks);
+    // task id -> number of appearences in `tasks_ordering`
+    std::vector<int> resumes_count(total_tasks);
 
     for (int next_task_id : tasks_ordering) {
-      resumes_count[next_task_id]++;
-    }
-
-    for (int next_task_id : tasks_ordering) {
-      bool is_new = started_tasks.contains(next_task_id)
-                        ? false
-                        : started_tasks.insert(next_task_id).second;
-      auto task_info = strategy.GetTask(next_task_id);
-
-      if (!task_info.has_value()) {
+      if (next_task_id < 0 || next_task_id >= total_tasks) {
         std::cerr << "No task with id " << next_task_id << " exists in round"
                   << std::endl;
         throw std::runtime_error("Invalid task id");
       }
+      resumes_count[next_task_id]++;
+    }
 
-      auto [next_task, thread_id] = task_info.value();
+    for (int next_task_id : tasks_ordering) {
+      bool is_new = !started_tasks[next_task_id];
+      started_tasks[next_task_id] = true;
+      auto [next_task, thread_id] = strategy.GetTask(next_task_id).value();
       if (is_new) {
         sequential_history.emplace_back(Invoke(next_task, thread_id));
       }
@@ -472,7 +605,7 @@ struct StrategyScheduler : public SchedulerWithReplay {
   }
 
  private:
-  Strategy& strategy;
+  StrategyT& strategy;
   ModelChecker& checker;
   PrettyPrinter& pretty_printer;
   size_t max_tasks;
@@ -480,6 +613,10 @@ struct StrategyScheduler : public SchedulerWithReplay {
   bool should_minimize_history;
   size_t exploration_runs;
   size_t minimization_runs;
+  // Seed of the run and the index of the first round of the scheduler, see
+  // ltest::GetRoundSeed().
+  uint64_t seed;
+  size_t first_round;
 };
 
 // TLAScheduler generates all executions satisfying some conditions.
@@ -488,7 +625,11 @@ struct TLAScheduler : Scheduler {
   TLAScheduler(size_t max_tasks, size_t max_rounds, size_t threads_count,
                size_t max_switches, size_t max_depth,
                std::vector<TaskBuilder> constructors, ModelChecker& checker,
-               PrettyPrinter& pretty_printer, std::function<void()> cancel_func)
+               PrettyPrinter& pretty_printer, std::function<void()> cancel_func,
+               size_t checkpoint_depth = 0, size_t checkpoint_stride = 1,
+               uint64_t seed = 0,
+               bool symmetry_reduction = false,
+               std::optional<ltest::VisitedStates::Mode> prune_states = {})
       : max_tasks{max_tasks},
         max_rounds{max_rounds},
         max_switches{max_switches},
@@ -496,7 +637,22 @@ struct TLAScheduler : Scheduler {
         checker{checker},
         pretty_printer{pretty_printer},
         max_depth(max_depth),
-        cancel(cancel_func) {
+        cancel(cancel_func),
+        checkpoints{checkpoint_depth, checkpoint_stride},
+        seed(seed) {
+    is_symmetric = symmetry_reduction &&
+                   std::all_of(this->constructors.begin(),
+                               this->constructors.end(), [](auto& cons) {
+                                 return cons.IsThreadIndependent();
+                               });
+    if (prune_states.has_value()) {
+      if constexpr (!kHasStateHash) {
+        throw std::invalid_argument{
+            "pruning the states needs StateHash() of the target"};
+      }
+      visited.emplace(*prune_states);
+    }
+    task_resumes.resize(threads_count);
     for (size_t i = 0; i < threads_count; ++i) {
       threads.emplace_back(Thread{
           .id = i,
@@ -506,7 +662,17 @@ struct TLAScheduler : Scheduler {
   };
 
   Scheduler::Result Run() override {
-    auto [_, res] = RunStep(0, 0);
+    // All rounds share the prefixes, so the arguments are generated by one
+    // sequence, the first round seeds it.
+    ltest::GetRuntimeContext().StartRound(0, ltest::GetRoundSeed(seed, 0));
+    auto [_, res] = Explore();
+    if (visited.has_value()) {
+      auto visits = visited->GetVisits();
+      auto pruned = visited->GetPruned();
+      std::cout << "states: visits = " << visits << ", pruned = " << pruned
+                << " (" << (visits == 0 ? 0 : 100.0 * pruned / visits)
+                << "%)\n";
+    }
     return res;
   }
 
@@ -529,28 +695,50 @@ struct TLAScheduler : Scheduler {
   // ...     |         |    c    |        |
   //         |    f    |         |        |
   //                      .....
-  // Frame struct describes one row of this table.
+  // Frame struct describes one row of this table. The rows are explored
+  // depth-first with an explicit stack of the frames: a frame keeps the
+  // choice of its step that is explored now, where to continue with the next
+  // one, and what to undo when its branch is over.
   struct Frame {
     // Pointer to the in task thread.
     Task* task{};
     // Is true if the task was created at this step.
     bool is_new{};
+    // The choice: the thread, and the constructor if the task is new.
+    size_t thread{};
+    size_t constructor{};
+    // Is true if the task of the thread was already chosen to resume.
+    bool is_resumed{};
+    // Is true while the branch of the choice is explored.
+    bool in_branch{};
+    // Number of the switches before the step.
+    size_t switches{};
+    // Is true while all threads seen by the choices are parked or blocked on
+    // a futex.
+    bool all_parked{true};
+    // Undo record of the choice.
+    bool is_finished{};
+    size_t full_history_size{};
+    ltest::TaskArena::Mark arena_mark{};
+    // Hash of the sequential history since the last step after which no task
+    // runs, see HashEvents().
+    uint64_t history_hash{};
+  };
+
+  static constexpr bool kHasStateHash = requires(const TargetObj& target) {
+    { target.StateHash() } -> std::convertible_to<size_t>;
   };
 
-  // Terminates all running tasks.
-  // We do it in a dangerous way: in random order.
-  // Actually, we assume obstruction free here.
+  // Terminates all running tasks, see ltest::TaskTerminator.
   // cancel() func takes care for graceful shutdown
   void TerminateTasks() {
     cancel();
     for (size_t i = 0; i < threads.size(); ++i) {
-      for (size_t j = 0; j < threads[i].tasks.size(); ++j) {
-        auto& task = threads[i].tasks[j];
-        if (!task->IsReturned()) {
-          task->Terminate();
-        }
-      }
+      terminator.AddThread(threads[i].tasks);
     }
+    terminator.Terminate([this] {
+      ltest::ResetTarget(state, state_in_round_heap, false);
+    });
   }
 
   // Replays all actions from 0 to the step_end.
@@ -558,7 +746,7 @@ struct TLAScheduler : Scheduler {
     // Firstly, terminate all running tasks.
     TerminateTasks();
     // In histories we store references, so there's no need to update it.
-    state.Reset();
+    ltest::ResetTarget(state, state_in_round_heap, true);
     for (size_t step = 0; step < step_end; ++step) {
       auto& frame = frames[step];
       auto task = frame.task;
@@ -572,10 +760,11 @@ struct TLAScheduler : Scheduler {
       }
       (*task)->Resume();
     }
-    coroutine_status.reset();
+    ltest::GetRuntimeContext().coroutine_status.reset();
   }
 
   void UpdateFullHistory(size_t thread_id, Task& task, bool is_new) {
+    auto& coroutine_status = ltest::GetRuntimeContext().coroutine_status;
     if (coroutine_status.has_value()) {
       if (is_new) {
         assert(coroutine_status->has_started);
@@ -598,159 +787,317 @@ struct TLAScheduler : Scheduler {
       full_history.emplace_back(thread_id, task);
     }
   }
-  // Resumes choosed task.
-  // If task is finished and finished tasks == max_tasks, stops.
-  std::tuple<bool, typename Scheduler::Result> ResumeTask(
-      Frame& frame, size_t step, size_t switches, Thread& thread, bool is_new) {
-    auto thread_id = thread.id;
+  // Moves the frame to its next choice, returns false if there are no more.
+  // The threads are tried in order: the running task of a thread is resumed,
+  // or a thread without one gets a new task of each allowed constructor.
+  bool NextChoice(Frame& frame) {
+    for (; frame.thread < threads.size(); ++frame.thread) {
+      size_t i = frame.thread;
+      auto& tasks = threads[i].tasks;
+      if (!tasks.empty() && !tasks.back()->IsReturned()) {
+        frame.constructor = 0;
+        if (tasks.back()->IsParked() || tasks.back()->IsBlocked()) {
+          continue;
+        }
+        frame.all_parked = false;
+        if (frame.is_resumed) {
+          frame.is_resumed = false;
+          continue;
+        }
+        if (!verifier.Verify(
+                CreatedTaskMetaData{tasks.back()->GetMethodId(), false, i})) {
+          continue;
+        }
+        // Task exists.
+        frame.is_new = false;
+        frame.is_resumed = true;
+        return true;
+      }
+
+      frame.all_parked = false;
+      // Choose constructor to create task.
+      bool stop = started_tasks == max_tasks;
+      if (!stop && tasks.size() < max_depth && !HasSymmetricBefore(i)) {
+        for (; frame.constructor < constructors.size(); ++frame.constructor) {
+          auto& cons = constructors[frame.constructor];
+          if (verifier.Verify(
+                  CreatedTaskMetaData{cons.GetMethodId(), true, i})) {
+            frame.is_new = true;
+            return true;
+          }
+        }
+      }
+      frame.constructor = 0;
+    }
+    return false;
+  }
+
+  // Returns true if the threads are symmetric and a thread before this one,
+  // without a running task too, has the same tasks (methods, arguments and
+  // results). Then swapping the two threads maps the branches of one to the
+  // branches of the other, so only the first thread of such a class gets new
+  // tasks. At the start all threads are empty, and that cuts the search by
+  // up to threads! times.
+  bool HasSymmetricBefore(size_t thread) const {
+    if (!is_symmetric) {
+      return false;
+    }
+    auto& tasks = threads[thread].tasks;
+    for (size_t j = 0; j < thread; ++j) {
+      auto& other = threads[j].tasks;
+      if (other.size() != tasks.size() ||
+          (!other.empty() && !other.back()->IsReturned())) {
+        continue;
+      }
+      bool is_same = true;
+      for (size_t k = 0; k < tasks.size() && is_same; ++k) {
+        is_same = tasks[k]->GetMethodId() == other[k]->GetMethodId() &&
+                  tasks[k]->GetRetVal() == other[k]->GetRetVal() &&
+                  tasks[k]->HasEqualArgs(*other[k]);
+      }
+      if (is_same) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Moves the frame past its current choice.
+  void SkipChoice(Frame& frame) {
+    if (frame.is_new) {
+      ++frame.constructor;
+    }
+  }
+
+  // Returns the number of the switches after the choice of the frame, or
+  // nullopt if the choice exceeds the limit of them.
+  std::optional<size_t> CountSwitches(const Frame& frame) const {
     size_t previous_thread_id = thread_id_history.empty()
                                     ? std::numeric_limits<size_t>::max()
                                     : thread_id_history.back();
-    size_t nxt_switches = switches;
-    if (!is_new) {
-      if (thread_id != previous_thread_id) {
+    size_t nxt_switches = frame.switches;
+    if (!frame.is_new) {
+      if (threads[frame.thread].id != previous_thread_id) {
         ++nxt_switches;
       }
       if (nxt_switches > max_switches) {
         // The limit of switches is achieved.
         // So, do not resume task.
-        return {false, {}};
+        return std::nullopt;
       }
     }
-    auto& task = thread.tasks.back();
+    return nxt_switches;
+  }
+
+  // Makes the choice of the frame: creates the task if it's new and resumes
+  // it.
+  void MakeChoice(Frame& frame) {
+    auto& thread = threads[frame.thread];
+    auto thread_id = thread.id;
+    auto& tasks = thread.tasks;
+    if (frame.is_new) {
+      frame.arena_mark = arena.GetMark();
+      // The tasks are numbered in the order they start in, a branch reuses
+      // the numbers of the tasks undone by the backtracking.
+      tasks.emplace_back(constructors[frame.constructor].Build(
+          arena, &state, thread_id, static_cast<int>(started_tasks)));
+      started_tasks++;
+    }
+    auto& task = tasks.back();
     frame.task = &task;
+    frame.full_history_size = full_history.size();
 
     thread_id_history.push_back(thread_id);
-    if (is_new) {
+    if (frame.is_new) {
       sequential_history.emplace_back(Invoke(task, thread_id));
     }
 
-    assert(!task->IsParked());
+    assert(!task->IsParked() && !task->IsBlocked());
     task->Resume();
-    UpdateFullHistory(thread_id, task, is_new);
-    bool is_finished = task->IsReturned();
-    if (is_finished) {
+    UpdateFullHistory(thread_id, task, frame.is_new);
+    frame.is_finished = task->IsReturned();
+    if (frame.is_finished) {
       finished_tasks++;
-      verifier.OnFinished(TaskWithMetaData{task, false, thread.id});
+      verifier.OnFinished(TaskWithMetaData{task, false, thread_id});
       auto result = task->GetRetVal();
       sequential_history.emplace_back(Response(task, result, thread_id));
     }
+    task_resumes[thread_id] = frame.is_new ? 1 : task_resumes[thread_id] + 1;
+    if (visited.has_value()) {
+      HashEvents(frame);
+    }
+  }
 
-    bool stop = finished_tasks == max_tasks;
-    if (!stop) {
-      // Run recursive step.
-      auto [is_over, res] = RunStep(step + 1, nxt_switches);
-      if (is_over || res.has_value()) {
-        return {is_over, res};
-      }
-    } else {
-      log() << "run round: " << finished_rounds << "\n";
-      pretty_printer.PrettyPrint(full_history, log());
-      log() << "===============================================\n\n";
-      log().flush();
-      // Stop, check if the the generated history is linearizable.
-      ++finished_rounds;
-      if (!checker.Check(sequential_history)) {
-        return {false,
-                std::make_pair(Scheduler::FullHistory{}, sequential_history)};
-      }
-      if (finished_rounds == max_rounds) {
-        // It was the last round.
-        return {true, {}};
-      }
+  // Adds the events of the step to the hash of the sequential history since
+  // the last step after which no task runs. After such a step the hash
+  // starts over if the history is linearizable, see Fingerprint().
+  void HashEvents(Frame& frame) {
+    size_t step = &frame - frames.data();
+    uint64_t hash = step == 0 ? 0 : frames[step - 1].history_hash;
+    auto& task = *frame.task;
+    if (frame.is_new) {
+      uint64_t args_hash =
+          ltest::MixSeed(task->GetMethodId() ^ task->GetArgsHash());
+      hash = ltest::MixSeed(hash ^ ltest::MixSeed(args_hash ^ frame.thread));
+    }
+    if (frame.is_finished) {
+      hash = ltest::MixSeed(hash ^ ltest::MixSeed(task->GetRetVal().Hash() +
+                                                  frame.thread + 1));
     }
+    if (started_tasks == finished_tasks && checker.Check(sequential_history)) {
+      hash = 0;
+    }
+    frame.history_hash = hash;
+  }
 
-    thread_id_history.pop_back();
-    // Removing combination of start of task + coroutine start
-    if (full_history.back().second.index() == 1) {
-      auto& cor = std::get<1>(full_history.back().second);
-      auto& prev = full_history[full_history.size() - 2];
-      int thread = full_history.back().first;
-      auto first_ind =
-          std::find_if(full_history.begin(), --full_history.end(),
-                       [&thread](auto& a) { return a.first == thread; });
-      if (cor.has_started &&
-          std::distance(full_history.begin(), first_ind) ==
-              full_history.size() - 2 &&
-          prev.second.index() == 0) {
-        full_history.pop_back();
+  // Returns the fingerprint of the state after the step of the frame: the
+  // state of the target, the number of the tasks of each thread, and the
+  // method, the arguments, the resumes and the waiting of its running task.
+  // The local variables of the tasks are not seen, so states that differ
+  // only in them are the same for the pruning.
+  // The history is needed only by the check of the round. While tasks run,
+  // the order of their events constrains the linearizations of the rest, so
+  // the history since the last step after which no task runs is a part of
+  // the fingerprint. The history before such a step is not: it's checked to
+  // be linearizable, and the rest of the round is linearizable the same way
+  // from the same state of the target, as long as StateHash() tells apart
+  // the states the specification tells apart.
+  uint64_t Fingerprint(const Frame& frame) const {
+    uint64_t hash = frame.history_hash;
+    if constexpr (kHasStateHash) {
+      hash = ltest::MixSeed(hash ^ state.StateHash());
+    }
+    for (size_t i = 0; i < threads.size(); ++i) {
+      auto& tasks = threads[i].tasks;
+      uint64_t thread_hash = tasks.size();
+      if (!tasks.empty() && !tasks.back()->IsReturned()) {
+        auto& task = tasks.back();
+        bool is_waiting = task->IsParked() || task->IsBlocked();
+        thread_hash = ltest::MixSeed(
+            thread_hash ^
+            ltest::MixSeed(task->GetMethodId() ^ task->GetArgsHash()));
+        thread_hash = ltest::MixSeed(thread_hash ^
+                                     (task_resumes[i] * 2 + is_waiting));
       }
+      hash = ltest::MixSeed(hash ^ thread_hash);
     }
-    full_history.pop_back();
-    if (is_finished) {
+    return hash;
+  }
+
+  // Undoes the histories and the counters of the choice of the frame.
+  void UndoChoice(Frame& frame) {
+    thread_id_history.pop_back();
+    // A new task is started only after the previous one of the thread has
+    // returned, and the resumes of the returned tasks are not counted.
+    task_resumes[frame.thread] =
+        frame.is_new ? 0 : task_resumes[frame.thread] - 1;
+    full_history.erase(full_history.begin() + frame.full_history_size,
+                       full_history.end());
+    if (frame.is_finished) {
       --finished_tasks;
       // resp.
       sequential_history.pop_back();
     }
-    if (is_new) {
+    if (frame.is_new) {
       // inv.
       --started_tasks;
       sequential_history.pop_back();
     }
+  }
 
-    return {false, {}};
+  // Returns to the state of the step after the branch of its choice.
+  void FinishBranch(Frame& frame, size_t step) {
+    UndoChoice(frame);
+    if (fork_step == step) {
+      // The forked child has explored its branch.
+      checkpoints.ExitChild(finished_rounds);
+    }
+    // As we can't return to the past in coroutine, we need to replay all
+    // tasks from the beginning.
+    Replay(step);
+    if (frame.is_new) {
+      // Replay terminates the new task too, so it can be removed after.
+      threads[frame.thread].tasks.pop_back();
+      // Tasks are created and removed in LIFO order.
+      arena.Rewind(frame.arena_mark);
+    }
+    SkipChoice(frame);
   }
 
-  std::tuple<bool, typename Scheduler::Result> RunStep(size_t step,
-                                                       size_t switches) {
-    // Push frame to the stack.
-    frames.emplace_back(Frame{});
-    auto& frame = frames.back();
+  // Checks the round that has finished max_tasks. Returns true if it was the
+  // last round.
+  std::tuple<bool, typename Scheduler::Result> FinishRound() {
+    log() << "run round: " << finished_rounds << "\n";
+    if (log().verbose) {
+      pretty_printer.PrettyPrint(full_history, log());
+    }
+    log() << "===============================================\n\n";
+    log().flush();
+    // Stop, check if the the generated history is linearizable.
+    ++finished_rounds;
+    if (!checker.Check(sequential_history)) {
+      return {false,
+              std::make_pair(Scheduler::FullHistory{}, sequential_history)};
+    }
+    return {finished_rounds == max_rounds, {}};
+  }
 
-    bool all_parked = true;
-    // Pick next task.
-    for (size_t i = 0; i < threads.size(); ++i) {
-      auto& thread = threads[i];
-      auto& tasks = thread.tasks;
-      if (!tasks.empty() && !tasks.back()->IsReturned()) {
-        if (tasks.back()->IsParked()) {
+  // Explores the executions depth-first. The top frame is the current step:
+  // its next choice is made and a frame for the next step is pushed, and a
+  // frame without more choices is popped, so the branch of the frame below
+  // is over.
+  // At the checkpoint steps every choice is explored by a forked child, while
+  // this process stays in the state of the step and continues with the next
+  // choice after the child, see ltest::ForkCheckpoints.
+  std::tuple<bool, typename Scheduler::Result> Explore() {
+    frames.clear();
+    frames.push_back(Frame{});
+    while (!frames.empty()) {
+      size_t step = frames.size() - 1;
+      auto& frame = frames.back();
+      if (frame.in_branch) {
+        frame.in_branch = false;
+        FinishBranch(frame, step);
+      }
+      if (!NextChoice(frame)) {
+        assert(!frame.all_parked && "deadlock");
+        frames.pop_back();
+        continue;
+      }
+
+      auto switches = CountSwitches(frame);
+      if (!switches.has_value()) {
+        SkipChoice(frame);
+        continue;
+      }
+      if (checkpoints.IsCheckpoint(step)) {
+        if (!checkpoints.Fork()) {
+          finished_rounds = checkpoints.Wait();
+          SkipChoice(frame);
           continue;
         }
-        all_parked = false;
-        if (!verifier.Verify(CreatedTaskMetaData{
-                std::string{tasks.back()->GetName()}, false, i})) {
+        fork_step = step;
+      }
+      MakeChoice(frame);
+      frame.in_branch = true;
+
+      if (finished_tasks != max_tasks) {
+        // The branch from a visited state is explored already.
+        if (visited.has_value() &&
+            visited->Visit(Fingerprint(frame), *switches, frame.thread)) {
           continue;
         }
-        // Task exists.
-        frame.is_new = false;
-        auto [is_over, res] = ResumeTask(frame, step, switches, thread, false);
-        if (is_over || res.has_value()) {
-          return {is_over, res};
-        }
-        // As we can't return to the past in coroutine, we need to replay all
-        // tasks from the beginning.
-        Replay(step);
+        frames.push_back(Frame{.switches = *switches});
         continue;
       }
-
-      all_parked = false;
-      // Choose constructor to create task.
-      bool stop = started_tasks == max_tasks;
-      if (!stop && threads[i].tasks.size() < max_depth) {
-        for (auto cons : constructors) {
-          if (!verifier.Verify(CreatedTaskMetaData{cons.GetName(), true, i})) {
-            continue;
-          }
-          frame.is_new = true;
-          auto size_before = tasks.size();
-          tasks.emplace_back(cons.Build(&state, i, -1/* TODO: fix task id for tla, because it is Scheduler and not Strategy class for some reason */));
-          started_tasks++;
-          auto [is_over, res] = ResumeTask(frame, step, switches, thread, true);
-          if (is_over || res.has_value()) {
-            return {is_over, res};
-          }
-          tasks.pop_back();
-          auto size_after = thread.tasks.size();
-          assert(size_before == size_after);
-          // As we can't return to the past in coroutine, we need to replay all
-          // tasks from the beginning.
-          Replay(step);
+      auto [is_over, res] = FinishRound();
+      if (is_over || res.has_value()) {
+        if (fork_step.has_value()) {
+          checkpoints.TakeOver();
         }
+        return {is_over, res};
       }
     }
-
-    assert(!all_parked && "deadlock");
-    frames.pop_back();
     return {false, {}};
   }
 
@@ -768,11 +1115,28 @@ struct TLAScheduler : Scheduler {
   size_t finished_tasks{};
   size_t finished_rounds{};
   TargetObj state{};
+  // Is the state created in the round heap, see ltest::ResetTarget().
+  bool state_in_round_heap{};
   std::vector<std::variant<Invoke, Response>> sequential_history;
   FullHistoryWithThreads full_history;
   std::vector<size_t> thread_id_history;
+  // Memory of the tasks.
+  ltest::TaskArena arena;
   StableVector<Thread> threads;
-  StableVector<Frame> frames;
+  std::vector<Frame> frames;
+  // Step at which this process was forked to explore one choice, see
+  // Explore().
+  std::optional<size_t> fork_step;
   Verifier verifier;
   std::function<void()> cancel;
+  ltest::TaskTerminator terminator;
+  ltest::ForkCheckpoints checkpoints;
+  uint64_t seed;
+  // Are the threads interchangeable, see HasSymmetricBefore().
+  bool is_symmetric;
+  // Number of the resumes of the running task of each thread, see
+  // Fingerprint().
+  std::vector<size_t> task_resumes;
+  // States reached by the explored branches, if they are pruned.
+  std::optional<ltest::VisitedStates> visited;
 };
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+namespace ltest {
+
+// Stack memory of a task. Stacks grow down, so `sp` points to the top of the
+// mapping, `size` includes the guard page.
+struct StackContext {
+  void* sp{};
+  size_t size{};
+};
+
+// StackPool hands out pre-mapped fiber stacks and recycles them when the
+// fiber returns, so creating and restarting tasks doesn't hit mmap/munmap.
+// Each stack has a guard page at the bottom and may be backed by
+// transparent huge pages.
+class StackPool {
+ public:
+  struct Stats {
+    // Number of stacks taken from the free list.
+    size_t hits;
+    // Number of stacks that had to be mapped.
+    size_t misses;
+  };
+
+  StackPool() = default;
+  StackPool(const StackPool&) = delete;
+  StackPool& operator=(const StackPool&) = delete;
+
+  // Sets the size of the stacks and pre-maps `preallocate` of them.
+  // Stacks that are already in the pool are dropped.
+  void Configure(size_t stack_size, size_t preallocate, bool huge_pages);
+
+  // Returns a free stack, mapping a new one if the pool is empty.
+  StackContext Allocate();
+
+  // Returns the stack to the pool.
+  void Deallocate(StackContext& sctx) noexcept;
+
+  Stats GetStats() const;
+
+  ~StackPool();
+
+ private:
+  StackContext Map() const;
+
+  void Unmap(StackContext& sctx) const noexcept;
+
+  void Clear() noexcept;
+
+  // Usable size of the stack, without the guard page.
+  size_t stack_size{};
+  bool huge_pages{};
+  std::vector<StackContext> free_stacks;
+  Stats stats{};
+};
+
+// Returns the pool used for the task stacks of the current thread, the
+// stacks must be returned to the pool on the thread they were taken on.
+StackPool& GetStackPool();
+
+}  // namespace ltest
@@ -2,9 +2,9 @@
 #include "scheduler.h"
 
 struct DefaultStrategyVerifier {
-  inline bool Verify(CreatedTaskMetaData task) { return true; }
+  inline bool Verify(CreatedTaskMetaData) { return true; }
 
-  inline void OnFinished(TaskWithMetaData task) {}
+  inline void OnFinished(TaskWithMetaData) {}
 
   inline void Reset() {}
   inline void UpdateState(std::string_view, int, bool){}
@@ -1,9 +1,9 @@
 #pragma once
 
-extern bool __trap_syscall;
-
 namespace ltest {
 
+/// Required for incapsulating syscall traps only in special places where it's
+/// really needed. Traps the syscalls of the current runtime context.
 struct SyscallTrapGuard {
   SyscallTrapGuard();
   ~SyscallTrapGuard();
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+struct CoroBase;
+
+namespace ltest {
+
+// TaskArena places the tasks of a round one after another in big chunks of
+// memory, so creating a task doesn't go to the allocator. The chunks are kept
+// between rounds, and the memory is rewound in LIFO order: all tasks at once
+// at the end of the round, or the tasks created after some mark (TLA).
+class TaskArena {
+ public:
+  // Position in the arena, see Rewind().
+  using Mark = size_t;
+
+  TaskArena() = default;
+  TaskArena(const TaskArena&) = delete;
+  TaskArena& operator=(const TaskArena&) = delete;
+
+  // Constructs the task in the arena.
+  template <typename T, typename... Args>
+  T* New(Args&&... args) {
+    auto pos = Position{chunk, offset};
+    void* ptr = Allocate(sizeof(T), alignof(T));
+    T* task = ::new (ptr) T(std::forward<Args>(args)...);
+    tasks.push_back({task, pos});
+    return task;
+  }
+
+  // Returns the mark of the current position.
+  Mark GetMark() const { return tasks.size(); }
+
+  // Destroys the tasks created after the mark, the newest first, and reuses
+  // their memory. The tasks may be suspended (e.g. blocked at the end of the
+  // round): the boost backend unwinds their stacks, where the yields do
+  // nothing, but with the asm and ucontext backends the objects on the stacks
+  // are never destroyed, the stacks just go back to the pool, see
+  // CoroContext.
+  void Rewind(Mark mark);
+
+  // Destroys all tasks.
+  void Clear() { Rewind(0); }
+
+  ~TaskArena();
+
+ private:
+  struct Chunk {
+    std::unique_ptr<std::byte[]> data;
+    size_t size;
+  };
+
+  struct Position {
+    size_t chunk;
+    size_t offset;
+  };
+
+  struct Entry {
+    CoroBase* task;
+    // Position of the arena before the task was allocated.
+    Position pos;
+  };
+
+  void* Allocate(size_t size, size_t alignment);
+
+  std::vector<Chunk> chunks;
+  // Index of the chunk the next task is placed into.
+  size_t chunk{};
+  // Offset of the free memory in the chunk.
+  size_t offset{};
+  std::vector<Entry> tasks;
+};
+
+}  // namespace ltest
@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include "lib.h"
+
+namespace ltest {
+
+// TaskTerminator terminates the tasks of a round that may wait on each
+// other. It keeps the wait-for graph of the unfinished tasks: a task parked
+// with Token::Park(holder) waits for the owner of the holder token, a task
+// parked without a holder or blocked on a futex waits for any task, as the
+// runtime doesn't know who is going to wake it. The tasks are resumed in the
+// topological order of the graph: the tasks others wait for first, and the
+// tasks of a thread one after another.
+// When the graph has a cycle, or every unfinished task waits (or they spin
+// without returning), the deadlock is reported to the log, the target is
+// reset to release the tasks and they are woken spuriously. The tasks that
+// deadlock again are left suspended.
+class TaskTerminator {
+ public:
+  // Adds the thread, its tasks are terminated in order.
+  template <typename Tasks>
+  void AddThread(const Tasks& tasks) {
+    if (threads_count == threads.size()) {
+      threads.emplace_back();
+    }
+    auto& thread = threads[threads_count++];
+    thread.clear();
+    for (size_t i = 0; i < tasks.size(); ++i) {
+      thread.push_back(tasks[i]);
+    }
+  }
+
+  // Terminates the tasks of the added threads and removes the threads,
+  // reset releases the deadlocked tasks, e.g. it resets the target.
+  // Returns the number of the tasks left suspended.
+  size_t Terminate(const std::function<void()>& reset);
+
+ private:
+  static constexpr size_t kNone = std::numeric_limits<size_t>::max();
+
+  // Returns the first unfinished task of the thread or nullptr.
+  Task Head(size_t thread);
+
+  // Builds the wait-for graph of the first unfinished tasks of the threads.
+  // Returns the threads of a cycle in the graph, empty if there is none.
+  std::vector<size_t> BuildGraph();
+
+  // Puts the runnable threads into `order`, the threads the waiting ones
+  // wait for first.
+  void SortRunnable();
+
+  void ReportDeadlock(const std::vector<size_t>& cycle);
+
+  // Tasks of the added threads, the vectors are reused by the next
+  // terminations.
+  std::vector<std::vector<Task>> threads;
+  size_t threads_count{};
+  // Index of the first unfinished task of each thread.
+  std::vector<size_t> heads;
+  // Thread the first unfinished task of the thread waits for, kNone if it
+  // doesn't wait or waits for any task.
+  std::vector<size_t> waits_for;
+  // Runnable threads in the order they are resumed.
+  std::vector<size_t> order;
+};
+
+}  // namespace ltest
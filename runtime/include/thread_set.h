@@ -0,0 +1,108 @@
+#pragma once
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ltest {
+
+// ThreadSet is a set of thread indexes stored as a bitset, the strategies
+// keep the runnable threads in it. Lookups go word by word with
+// popcount/countr_zero, so they cost threads / 64 steps at most.
+class ThreadSet {
+ public:
+  // Makes the set of the threads [0, threads_count) empty.
+  void Reset(size_t threads_count) {
+    words.assign((threads_count + kWordBits - 1) / kWordBits, 0);
+    count = 0;
+  }
+
+  bool Contains(size_t thread) const {
+    return (words[thread / kWordBits] >> (thread % kWordBits)) & 1;
+  }
+
+  // Returns true if the thread was not in the set.
+  bool Insert(size_t thread) {
+    if (Contains(thread)) {
+      return false;
+    }
+    words[thread / kWordBits] |= Bit(thread);
+    ++count;
+    return true;
+  }
+
+  // Returns true if the thread was in the set.
+  bool Erase(size_t thread) {
+    if (!Contains(thread)) {
+      return false;
+    }
+    words[thread / kWordBits] &= ~Bit(thread);
+    --count;
+    return true;
+  }
+
+  size_t Size() const { return count; }
+
+  bool Empty() const { return count == 0; }
+
+  // Returns the first thread of the set not less than `from`, wrapping around
+  // to the beginning. The set must not be empty.
+  size_t NextCyclic(size_t from) const {
+    assert(!Empty());
+    size_t word = from / kWordBits;
+    if (word < words.size()) {
+      auto bits = words[word] & (~uint64_t{0} << (from % kWordBits));
+      if (bits != 0) {
+        return word * kWordBits + std::countr_zero(bits);
+      }
+    }
+    for (size_t i = 1; i <= words.size(); ++i) {
+      auto w = (word + i) % words.size();
+      if (words[w] != 0) {
+        return w * kWordBits + std::countr_zero(words[w]);
+      }
+    }
+    assert(false && "unreachable");
+    return 0;
+  }
+
+  // Returns the k-th smallest thread of the set, k < Size().
+  size_t Select(size_t k) const {
+    assert(k < count);
+    for (size_t w = 0;; ++w) {
+      auto bits = words[w];
+      auto ones = static_cast<size_t>(std::popcount(bits));
+      if (k >= ones) {
+        k -= ones;
+        continue;
+      }
+      for (; k > 0; --k) {
+        bits &= bits - 1;
+      }
+      return w * kWordBits + std::countr_zero(bits);
+    }
+  }
+
+  // Calls f(thread) for the threads of the set in increasing order.
+  template <typename F>
+  void ForEach(F f) const {
+    for (size_t w = 0; w < words.size(); ++w) {
+      for (auto bits = words[w]; bits != 0; bits &= bits - 1) {
+        f(w * kWordBits + std::countr_zero(bits));
+      }
+    }
+  }
+
+ private:
+  static constexpr size_t kWordBits = 64;
+
+  static uint64_t Bit(size_t thread) {
+    return uint64_t{1} << (thread % kWordBits);
+  }
+
+  std::vector<uint64_t> words;
+  size_t count{};
+};
+
+}  // namespace ltest
@@ -1,47 +1,178 @@
 #pragma once
 
 #include <any>
+#include <cstddef>
 #include <functional>
+#include <new>
 #include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
 class ValueWrapper;
 
-using ToStringFunc = std::function<std::string(const ValueWrapper&)>;
-using CompFunc = std::function<bool(const ValueWrapper&, const ValueWrapper&)>;
+using ToStringFunc = std::string (*)(const ValueWrapper&);
+using CompFunc = bool (*)(const ValueWrapper&, const ValueWrapper&);
 
 template <typename T>
 ToStringFunc GetDefaultToString();
 template <typename T>
 CompFunc GetDefaultCompator();
 
+// ValueWrapper holds a value of any type, e.g. the result of a task.
+// Small trivially copyable values (ints, bools, optionals of them) are stored
+// inline, so creating and copying the wrapper doesn't allocate, other values
+// are stored on the heap. Type-specific operations are taken from the static
+// vtable of the type, compare and to_str are plain function pointers.
 class ValueWrapper {
-  std::any value;
-  CompFunc compare;
-  ToStringFunc to_str;
-
  public:
   ValueWrapper() = default;
 
   template <typename T>
-  ValueWrapper(const T& t, const CompFunc& cmp = GetDefaultCompator<T>(),
-               const ToStringFunc& str = GetDefaultToString<T>())
-      : value(t), compare(cmp), to_str(str) {}
+  ValueWrapper(const T& t, CompFunc cmp = GetDefaultCompator<T>(),
+               ToStringFunc str = GetDefaultToString<T>())
+      : vtable(&kVTable<T>), compare(cmp), to_str(str) {
+    if constexpr (kIsInline<T>) {
+      ::new (storage.buffer) T(t);
+    } else {
+      storage.heap = new T(t);
+    }
+  }
+
+  ValueWrapper(const ValueWrapper& other)
+      : vtable(other.vtable), compare(other.compare), to_str(other.to_str) {
+    if (vtable != nullptr && vtable->copy != nullptr) {
+      vtable->copy(storage, other.storage);
+    } else {
+      storage = other.storage;
+    }
+  }
+
+  ValueWrapper(ValueWrapper&& other) noexcept
+      : vtable(std::exchange(other.vtable, nullptr)),
+        compare(other.compare),
+        to_str(other.to_str),
+        storage(other.storage) {}
+
+  ValueWrapper& operator=(const ValueWrapper& other) {
+    if (this != &other) {
+      ValueWrapper copy{other};
+      *this = std::move(copy);
+    }
+    return *this;
+  }
+
+  ValueWrapper& operator=(ValueWrapper&& other) noexcept {
+    if (this != &other) {
+      Destroy();
+      vtable = std::exchange(other.vtable, nullptr);
+      compare = other.compare;
+      to_str = other.to_str;
+      storage = other.storage;
+    }
+    return *this;
+  }
+
+  ~ValueWrapper() { Destroy(); }
+
   bool operator==(const ValueWrapper& other) const {
+    if (compare == nullptr) {
+      return !HasValue() && !other.HasValue();
+    }
     return compare(*this, other);
   }
   //using std::to_string
   friend std::string to_string(const ValueWrapper& wrapper) { // NOLINT
-    return wrapper.to_str(wrapper);
+    return wrapper.to_str != nullptr ? wrapper.to_str(wrapper) : "";
   }
-  bool HasValue() const { return value.has_value(); }
+  bool HasValue() const { return vtable != nullptr; }
+  // Returns the hash of the value, values equal by the default comparator
+  // have equal hashes. Types without std::hash are hashed by the type only.
+  size_t Hash() const { return vtable != nullptr ? vtable->hash(*this) : 0; }
   template <typename T>
   T GetValue() const {
-    return std::any_cast<T>(value);
+    if (vtable == nullptr || *vtable->type != typeid(T)) {
+      throw std::bad_any_cast{};
+    }
+    return *Get<T>();
   }
+
+ private:
+  static constexpr size_t kInlineSize = 16;
+  static constexpr size_t kInlineAlign = alignof(void*);
+
+  union Storage {
+    alignas(kInlineAlign) std::byte buffer[kInlineSize];
+    void* heap;
+  };
+
+  template <typename T>
+  static constexpr bool kIsInline =
+      std::is_trivially_copyable_v<T> && sizeof(T) <= kInlineSize &&
+      alignof(T) <= kInlineAlign;
+
+  // Operations on the stored value, copy and destroy are null for the inline
+  // values, they are copied bytewise.
+  struct VTable {
+    const std::type_info* type;
+    void (*copy)(Storage& dst, const Storage& src);
+    void (*destroy)(Storage& storage);
+    size_t (*hash)(const ValueWrapper& wrapper);
+  };
+
+  template <typename T>
+  static size_t HashValue(const ValueWrapper& wrapper) {
+    if constexpr (requires(const T& t) { std::hash<T>{}(t); }) {
+      return std::hash<T>{}(*wrapper.Get<T>());
+    } else {
+      return typeid(T).hash_code();
+    }
+  }
+
+  template <typename T>
+  static constexpr VTable MakeVTable() {
+    if constexpr (kIsInline<T>) {
+      return VTable{&typeid(T), nullptr, nullptr, &HashValue<T>};
+    } else {
+      return VTable{
+          &typeid(T),
+          [](Storage& dst, const Storage& src) {
+            dst.heap = new T(*static_cast<const T*>(src.heap));
+          },
+          [](Storage& storage) { delete static_cast<T*>(storage.heap); },
+          &HashValue<T>};
+    }
+  }
+
+  template <typename T>
+  static constexpr VTable kVTable = MakeVTable<T>();
+
+  template <typename T>
+  const T* Get() const {
+    if constexpr (kIsInline<T>) {
+      return std::launder(reinterpret_cast<const T*>(storage.buffer));
+    } else {
+      return static_cast<const T*>(storage.heap);
+    }
+  }
+
+  void Destroy() {
+    if (vtable != nullptr && vtable->destroy != nullptr) {
+      vtable->destroy(storage);
+    }
+    vtable = nullptr;
+  }
+
+  const VTable* vtable{};
+  CompFunc compare{};
+  ToStringFunc to_str{};
+  Storage storage{};
 };
 template <typename T>
 ToStringFunc GetDefaultToString() {
-  using std::to_string;
-  return [](const ValueWrapper& a) { return to_string(a.GetValue<T>()); };
+  return [](const ValueWrapper& a) {
+    using std::to_string;
+    return to_string(a.GetValue<T>());
+  };
 }
 
 template <typename T>
@@ -61,5 +192,6 @@ CompFunc GetDefaultCompator() {
 
 class Void {};
 
-static ValueWrapper void_v{Void{}, [](auto& a, auto& b) { return true; },
-                           [](auto& a) { return "void"; }};
\ No newline at end of file
+static ValueWrapper void_v{
+    Void{}, [](const ValueWrapper&, const ValueWrapper&) { return true; },
+    [](const ValueWrapper&) -> std::string { return "void"; }};
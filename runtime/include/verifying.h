@@ -1,9 +1,15 @@
 #pragma once
 #include <gflags/gflags.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include <type_traits>
 
+#include "dpor_scheduler.h"
 #include "lib.h"
 #include "lincheck_recursive.h"
 #include "logger.h"
@@ -18,7 +24,7 @@
 
 namespace ltest {
 
-enum StrategyType { RR, RND, TLA, PCT };
+enum StrategyType { RR, RND, TLA, PCT, DPOR };
 
 constexpr const char *GetLiteral(StrategyType t);
 
@@ -53,6 +59,23 @@ struct Opts {
   bool syscall_trap;
   StrategyType typ;
   std::vector<int> thread_weights;
+  size_t stack_size;
+  size_t stack_pool;
+  bool huge_pages;
+  bool shared_stack;
+  size_t workers;
+  bool round_heap;
+  size_t checkpoint_depth;
+  size_t checkpoint_stride;
+  bool symmetry;
+  // How the TLA states are pruned, see VisitedStates, nullopt if they aren't.
+  std::optional<VisitedStates::Mode> prune_states;
+  size_t fork_batch;
+  // Seed of the run, the round index and it determine the round, see
+  // GetRoundSeed().
+  uint64_t seed;
+  // Index of the first round to explore.
+  size_t first_round;
 };
 
 struct DefaultOptions {
@@ -73,18 +96,37 @@ void SetOpts(const DefaultOptions &def);
 
 Opts ParseOpts();
 
+// Prints the name of the strategy.
+void PrintStrategy(StrategyType typ);
+
+// Gives the calling thread of a forked child an alternate stack for the
+// crash handler, does nothing outside of the children.
+void SetCrashSignalStack();
+
+// Runs opts.rounds rounds in forked children, opts.fork_batch rounds each,
+// run_batch explores the rounds of a child. A crashed child is reported with
+// the index of the crashed round and the next one goes on with the rest of
+// the batch after it, so a crash loses neither the campaign nor the batch.
+// A child that dies without the report has its batch split in halves and run
+// again.
+// Returns 1 if a bug is found or a child has crashed.
+int RunForkServer(
+    const Opts &opts,
+    const std::function<int(const Opts &, StackPool::Stats &)> &run_batch,
+    StackPool::Stats &stack_stats);
+
 std::vector<std::string> split(const std::string &s, char delim);
 
-template <typename TargetObj, StrategyVerifier Verifier>
-std::unique_ptr<Strategy> MakeStrategy(Opts &opts, std::vector<TaskBuilder> l) {
+// Makes the strategy of opts.typ and passes it to make as the unique_ptr of
+// its concrete type, returns the result of make.
+template <typename TargetObj, StrategyVerifier Verifier, typename F>
+auto VisitStrategy(Opts &opts, std::vector<TaskBuilder> l, F make) {
   switch (opts.typ) {
     case RR: {
-      std::cout << "round-robin\n";
-      return std::make_unique<RoundRobinStrategy<TargetObj, Verifier>>(
-          opts.threads, std::move(l));
+      return make(std::make_unique<RoundRobinStrategy<TargetObj, Verifier>>(
+          opts.threads, std::move(l), opts.tasks));
     }
     case RND: {
-      std::cout << "random\n";
       std::vector<int> weights = opts.thread_weights;
       if (weights.empty()) {
         weights.assign(opts.threads, 1);
@@ -93,34 +135,43 @@ std::unique_ptr<Strategy> MakeStrategy(Opts &opts, std::vector<TaskBuilder> l) {
         throw std::invalid_argument{
             "number of threads not equal to number of weights"};
       }
-      return std::make_unique<RandomStrategy<TargetObj, Verifier>>(
-          opts.threads, std::move(l), std::move(weights));
+      return make(std::make_unique<RandomStrategy<TargetObj, Verifier>>(
+          opts.threads, std::move(l), opts.tasks, std::move(weights)));
     }
     case PCT: {
-      std::cout << "pct\n";
-      return std::make_unique<PctStrategy<TargetObj, Verifier>>(
-          opts.threads, std::move(l), opts.forbid_all_same);
+      return make(std::make_unique<PctStrategy<TargetObj, Verifier>>(
+          opts.threads, std::move(l), opts.tasks, opts.forbid_all_same));
     }
     default:
-      assert(false && "unexpected type");
+      throw std::invalid_argument{"unexpected strategy type"};
   }
 }
 
+template <typename TargetObj, StrategyVerifier Verifier>
+std::unique_ptr<Strategy> MakeStrategy(Opts &opts, std::vector<TaskBuilder> l) {
+  return VisitStrategy<TargetObj, Verifier>(
+      opts, std::move(l), [](auto strategy) -> std::unique_ptr<Strategy> {
+        return strategy;
+      });
+}
+
 // Keeps pointer to strategy to pass reference to base scheduler.
 // TODO: refactor.
-template <StrategyVerifier Verifier>
-struct StrategySchedulerWrapper : StrategyScheduler<Verifier> {
-  StrategySchedulerWrapper(std::unique_ptr<Strategy> strategy,
+template <StrategyVerifier Verifier, typename StrategyT = Strategy>
+struct StrategySchedulerWrapper : StrategyScheduler<Verifier, StrategyT> {
+  StrategySchedulerWrapper(std::unique_ptr<StrategyT> strategy,
                            ModelChecker &checker, PrettyPrinter &pretty_printer,
                            size_t max_tasks, size_t max_rounds, bool minimize,
-                           size_t exploration_runs, size_t minimization_runs)
+                           size_t exploration_runs, size_t minimization_runs,
+                           uint64_t seed, size_t first_round)
       : strategy(std::move(strategy)),
-        StrategyScheduler<Verifier>(*strategy.get(), checker, pretty_printer,
-                                    max_tasks, max_rounds, minimize,
-                                    exploration_runs, minimization_runs) {};
+        StrategyScheduler<Verifier, StrategyT>(
+            *strategy.get(), checker, pretty_printer, max_tasks, max_rounds,
+            minimize, exploration_runs, minimization_runs, seed,
+            first_round) {};
 
  private:
-  std::unique_ptr<Strategy> strategy;
+  std::unique_ptr<StrategyT> strategy;
 };
 
 template <typename TargetObj, StrategyVerifier Verifier>
@@ -128,42 +179,133 @@ std::unique_ptr<Scheduler> MakeScheduler(ModelChecker &checker, Opts &opts,
                                          const std::vector<TaskBuilder> &l,
                                          PrettyPrinter &pretty_printer,
                                          const std::function<void()> &cancel) {
-  std::cout << "strategy = ";
   switch (opts.typ) {
     case RR:
     case PCT:
     case RND: {
-      auto strategy = MakeStrategy<TargetObj, Verifier>(opts, std::move(l));
-      auto scheduler = std::make_unique<StrategySchedulerWrapper<Verifier>>(
-          std::move(strategy), checker, pretty_printer, opts.tasks, opts.rounds,
-          opts.minimize, opts.exploration_runs, opts.minimization_runs);
-      return scheduler;
+      // The scheduler is specialized for the concrete strategy, see
+      // StrategyScheduler.
+      return VisitStrategy<TargetObj, Verifier>(
+          opts, l, [&](auto strategy) -> std::unique_ptr<Scheduler> {
+            using StrategyT = typename decltype(strategy)::element_type;
+            return std::make_unique<
+                StrategySchedulerWrapper<Verifier, StrategyT>>(
+                std::move(strategy), checker, pretty_printer, opts.tasks,
+                opts.rounds, opts.minimize, opts.exploration_runs,
+                opts.minimization_runs, opts.seed, opts.first_round);
+          });
     }
     case TLA: {
-      std::cout << "tla\n";
       auto scheduler = std::make_unique<TLAScheduler<TargetObj, Verifier>>(
           opts.tasks, opts.rounds, opts.threads, opts.switches, opts.depth,
-          std::move(l), checker, pretty_printer, cancel);
+          std::move(l), checker, pretty_printer, cancel,
+          opts.checkpoint_depth, opts.checkpoint_stride, opts.seed,
+          opts.symmetry, opts.prune_states);
       return scheduler;
     }
+    case DPOR: {
+      return std::make_unique<DporScheduler<TargetObj, Verifier>>(
+          opts.tasks, opts.rounds, opts.threads, opts.depth, std::move(l),
+          checker, pretty_printer, cancel, opts.seed);
+    }
     default: {
       assert(false && "Unknown strategy type specified");
     }
   }
 }
 
+// Runs the scheduler, prints the nonlinearizable history under the
+// report_mutex if it is found and returns 1 in that case.
 inline int TrapRun(std::unique_ptr<Scheduler> &&scheduler,
-                   PrettyPrinter &pretty_printer) {
+                   PrettyPrinter &pretty_printer, std::mutex &report_mutex) {
   auto guard = SyscallTrapGuard{};
   auto result = scheduler->Run();
   if (result.has_value()) {
+    std::lock_guard lock{report_mutex};
+    // The seed and the round are enough to run the round again, see the
+    // replay_round option.
+    std::cout << "round = " << GetRuntimeContext().round << "\n";
     std::cout << "non linearized:\n";
     pretty_printer.PrettyPrint(result.value().second, std::cout);
     return 1;
+  }
+  return 0;
+}
+
+// Explores opts.rounds rounds on the current thread with its own scheduler,
+// checker and target object. Uses the runtime context of the thread.
+template <class Spec, StrategyVerifier Verifier>
+int Explore(Opts opts, std::mutex &report_mutex) {
+  GetStackPool().Configure(opts.stack_size, opts.stack_pool, opts.huge_pages);
+  CoroContext::SetSharedStack(opts.shared_stack);
+
+  PrettyPrinter pretty_printer{opts.threads};
+
+  using lchecker_t =
+      LinearizabilityCheckerRecursive<typename Spec::linear_spec_t,
+                                      typename Spec::linear_spec_hash_t,
+                                      typename Spec::linear_spec_equals_t>;
+  lchecker_t checker{Spec::linear_spec_t::GetMethods(),
+                     typename Spec::linear_spec_t{}};
+
+  // The heap outlives the scheduler, which owns the target object.
+  std::optional<RoundHeap> heap;
+  if (opts.round_heap) {
+    heap.emplace();
+  }
+  RoundHeapGuard heap_guard{heap ? &*heap : nullptr};
+
+  auto scheduler = MakeScheduler<typename Spec::target_obj_t, Verifier>(
+      checker, opts, task_builders, pretty_printer, &Spec::cancel_t::Cancel);
+  return TrapRun(std::move(scheduler), pretty_printer, report_mutex);
+}
+
+// Explores opts.rounds rounds on opts.workers threads, adds the stack pool
+// stats of the workers. Returns 1 if a bug is found.
+template <class Spec, StrategyVerifier Verifier>
+int ExploreWorkers(const Opts &opts, StackPool::Stats &total_stack_stats) {
+  // Each worker explores its share of the rounds with its own runtime
+  // context, the first one that finds a bug stops the others.
+  std::atomic<bool> stop{};
+  std::mutex report_mutex;
+  std::vector<RuntimeContext> contexts(opts.workers);
+  std::vector<int> results(opts.workers);
+  std::vector<StackPool::Stats> stack_stats(opts.workers);
+  auto explore = [&](size_t worker) {
+    SetCrashSignalStack();
+    auto &runtime = contexts[worker];
+    runtime.logger.verbose = opts.verbose;
+    runtime.stop = &stop;
+    RuntimeContextGuard guard{runtime};
+    auto worker_opts = opts;
+    worker_opts.rounds =
+        opts.rounds / opts.workers + (worker < opts.rounds % opts.workers);
+    worker_opts.first_round = opts.first_round +
+                              opts.rounds / opts.workers * worker +
+                              std::min(worker, opts.rounds % opts.workers);
+    results[worker] = Explore<Spec, Verifier>(worker_opts, report_mutex);
+    if (results[worker] != 0) {
+      stop = true;
+    }
+    stack_stats[worker] = GetStackPool().GetStats();
+  };
+  if (opts.workers == 1) {
+    explore(0);
   } else {
-    std::cout << "success!\n";
-    return 0;
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < opts.workers; ++i) {
+      workers.emplace_back(explore, i);
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
   }
+
+  for (auto &stats : stack_stats) {
+    total_stack_stats.hits += stats.hits;
+    total_stack_stats.misses += stats.misses;
+  }
+  return std::ranges::any_of(results, [](int r) { return r != 0; });
 }
 
 template <class Spec, StrategyVerifier Verifier = DefaultStrategyVerifier>
@@ -181,28 +323,34 @@ int Run(int argc, char *argv[]) {
   std::cout << "tasks    = " << opts.tasks << "\n";
   std::cout << "switches = " << opts.switches << "\n";
   std::cout << "rounds   = " << opts.rounds << "\n";
+  std::cout << "seed     = " << opts.seed << "\n";
   std::cout << "minimize = " << std::boolalpha << opts.minimize << "\n";
   if (opts.minimize) {
     std::cout << "exploration runs = " << opts.exploration_runs << "\n";
     std::cout << "minimization runs = " << opts.minimization_runs << "\n";
   }
+  std::cout << "workers  = " << opts.workers << "\n";
+  std::cout << "round heap = " << std::boolalpha << opts.round_heap << "\n";
+  if (opts.fork_batch != 0) {
+    std::cout << "fork batch = " << opts.fork_batch << "\n";
+  }
   std::cout << "targets  = " << task_builders.size() << "\n";
-
-  PrettyPrinter pretty_printer{opts.threads};
-
-  using lchecker_t =
-      LinearizabilityCheckerRecursive<typename Spec::linear_spec_t,
-                                      typename Spec::linear_spec_hash_t,
-                                      typename Spec::linear_spec_equals_t>;
-  lchecker_t checker{Spec::linear_spec_t::GetMethods(),
-                     typename Spec::linear_spec_t{}};
-
-  auto scheduler = MakeScheduler<typename Spec::target_obj_t, Verifier>(
-      checker, opts, std::move(task_builders), pretty_printer,
-      &Spec::cancel_t::Cancel);
+  std::cout << "strategy = ";
+  PrintStrategy(opts.typ);
   std::cout << "\n\n";
   std::cout.flush();
-  return TrapRun(std::move(scheduler), pretty_printer);
+
+  StackPool::Stats total_stack_stats{};
+  int res = opts.fork_batch == 0
+                ? ExploreWorkers<Spec, Verifier>(opts, total_stack_stats)
+                : RunForkServer(opts, ExploreWorkers<Spec, Verifier>,
+                                total_stack_stats);
+  if (res == 0) {
+    std::cout << "success!\n";
+  }
+  std::cout << "stack pool: hits = " << total_stack_stats.hits
+            << ", misses = " << total_stack_stats.misses << "\n";
+  return res;
 }
 
 }  // namespace ltest
@@ -215,4 +363,4 @@ int Run(int argc, char *argv[]) {
 #define LTEST_ENTRYPOINT(spec_obj_t)           \
   int main(int argc, char *argv[]) {           \
     return ltest::Run<spec_obj_t>(argc, argv); \
-  }\
+  }
@@ -1,6 +1,10 @@
 // Keeps as separated file because use in regression tests.
 #pragma once
 #include <cassert>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 
 #include "generators.h"
@@ -9,6 +13,8 @@
 
 namespace ltest {
 
+// Builders of the target methods, they are registered during the static
+// initialization and are only read after it.
 extern std::vector<TaskBuilder> task_builders;
 
 }  // namespace ltest
@@ -47,59 +53,78 @@ auto toStringList(const tuple_t &t) noexcept {
 }
 
 template <typename... Args>
-auto toStringArgs(std::shared_ptr<void> args) {
-  auto real_args = reinterpret_cast<std::tuple<Args...> *>(args.get());
-  return toStringList(*real_args);
+std::vector<std::string> toStringArgs(const std::tuple<Args...> &args) {
+  return toStringList(args);
 }
 
-template <typename Ret, typename Target, typename... Args>
-struct TargetMethod{
-  using Method = std::function<ValueWrapper(Target *, Args...)>;
-  TargetMethod(std::string_view method_name,
-               std::function<std::tuple<Args...>(size_t)> gen, Method method) {
-    auto builder = [gen = std::move(gen), method_name,
-                    method = std::move(method)](
-                       void *this_ptr, size_t thread_num, int task_id) -> Task {
-      auto args = std::shared_ptr<void>(new std::tuple(gen(thread_num)));
-      auto coro = Coro<Target, Args...>::New(method, this_ptr, args,
-                                             &ltest::toStringArgs<Args...>,
-                                             method_name, task_id);
-      if (ltest::generators::generated_token) {
-        coro->SetToken(ltest::generators::generated_token);
-        ltest::generators::generated_token.reset();
-      }
-      return coro;
-    };
-    ltest::task_builders.push_back(
-        TaskBuilder(std::string(method_name), builder));
+// Arguments of a task with the token the generator has made for it, see
+// genToken().
+template <typename... Args>
+struct TaskArgs {
+  std::tuple<Args...> args;
+  std::shared_ptr<Token> token;
+
+  friend bool operator==(const TaskArgs &a, const TaskArgs &b) {
+    return ArgsEqual(a.args, b.args);
+  }
+
+  friend std::string to_string(const TaskArgs &task_args) {
+    std::string result;
+    for (const auto &arg : toStringArgs(task_args.args)) {
+      result += result.empty() ? arg : ", " + arg;
+    }
+    return result;
   }
 };
 
+// Method is passed as a template argument, so the task stores a plain pointer
+// to Call() instead of a std::function.
+template <auto Method, typename Ret, typename Target, typename... Args>
+struct TargetMethod {
+  static ValueWrapper Call(Target *target, Args... args) {
+    if constexpr (std::is_void_v<Ret>) {
+      (target->*Method)(std::forward<Args>(args)...);
+      return void_v;
+    } else {
+      return (target->*Method)(std::forward<Args>(args)...);
+    }
+  }
 
-template <typename Target, typename... Args>
-struct TargetMethod<void, Target, Args...> {
-  using Method = std::function<void(Target *, Args...)>;
-
-  TargetMethod(std::string_view method_name,
-               std::function<std::tuple<Args...>(size_t)> gen, Method method) {
-    auto builder = [gen = std::move(gen), method_name,
-                    method = std::move(method)](
-                       void *this_ptr, size_t thread_num, int task_id) -> Task {
-      auto wrapper = [f = std::move(method)](void *this_ptr, Args &&...args) {
-                          f(reinterpret_cast<Target *>(this_ptr), std::forward<Args>(args)...);
-                          return void_v;
-                        };      auto args = std::shared_ptr<void>(new std::tuple(gen(thread_num)));
-      auto coro = Coro<Target, Args...>::New(wrapper, this_ptr, args,
-                                             &ltest::toStringArgs<Args...>,
-                                             method_name, task_id);
-      if (ltest::generators::generated_token) {
-        coro->SetToken(ltest::generators::generated_token);
-        ltest::generators::generated_token.reset();
+  // The generator makes the arguments of a task. It takes the number of the
+  // thread the task is built for, or nothing if the arguments don't depend
+  // on the thread, then the threads are interchangeable, see TLAScheduler.
+  // The random strategies generate the arguments of the round before it
+  // starts, see ltest::Scenario, so there the generator must not depend on
+  // the state of the target.
+  template <typename Gen>
+  TargetMethod(std::string_view method_name, Gen gen) {
+    constexpr bool is_thread_independent = std::is_invocable_v<Gen>;
+    auto gen_args = [gen = std::move(gen)](size_t thread_num) {
+      auto args = [&]() -> std::tuple<Args...> {
+        if constexpr (is_thread_independent) {
+          return gen();
+        } else {
+          return gen(thread_num);
+        }
+      }();
+      return ValueWrapper{TaskArgs<Args...>{
+          std::move(args), std::move(GetRuntimeContext().generated_token)}};
+    };
+    auto method_id = GetMethodId(method_name);
+    auto builder = [method_id](TaskArena &arena, void *this_ptr,
+                               const ValueWrapper &args, int task_id) -> Task {
+      auto task_args = args.GetValue<TaskArgs<Args...>>();
+      auto coro = arena.New<Coro<Target, Args...>>(
+          &Call, this_ptr, std::move(task_args.args),
+          &ltest::toStringArgs<Args...>, method_id, task_id);
+      if (task_args.token) {
+        coro->SetToken(std::move(task_args.token));
       }
       return coro;
     };
     ltest::task_builders.push_back(
-        TaskBuilder(std::string(method_name), builder));
+        TaskBuilder(std::string(method_name), std::move(gen_args),
+                    std::move(builder), is_thread_independent));
   }
 };
 
@@ -107,7 +132,7 @@ struct TargetMethod<void, Target, Args...> {
 
 #define declare_task_name(symbol) const char *symbol##_task_name = #symbol
 
-#define target_method(gen, ret, cls, symbol, ...)          \
-  declare_task_name(symbol);                               \
-  ltest::TargetMethod<ret, cls __VA_OPT__(, ) __VA_ARGS__> \
-      symbol##_ltest_method_cls{symbol##_task_name, gen, &cls::symbol};
+#define target_method(gen, ret, cls, symbol, ...)                        \
+  declare_task_name(symbol);                                             \
+  ltest::TargetMethod<&cls::symbol, ret, cls __VA_OPT__(, ) __VA_ARGS__> \
+      symbol##_ltest_method_cls{symbol##_task_name, gen};
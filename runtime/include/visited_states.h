@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace ltest {
+
+// VisitedStates is the set of the fingerprints of the states TLAScheduler
+// has reached, a branch that reaches a visited state again is pruned.
+// The exact mode keeps the fingerprints in an open addressing table together
+// with the fewest switches the state was reached with, so a state is pruned
+// only if it was reached with no more switches before. The approximate mode
+// keeps them in a Bloom filter, which takes a bit per state but may prune
+// a state that was not visited.
+// The memory is shared with the forked processes, so the states visited by
+// the children of the fork checkpoints are seen by their parent.
+class VisitedStates {
+ public:
+  enum class Mode { kExact, kApproximate };
+
+  explicit VisitedStates(Mode mode, size_t capacity = kDefaultCapacity);
+  VisitedStates(const VisitedStates&) = delete;
+  VisitedStates& operator=(const VisitedStates&) = delete;
+  ~VisitedStates();
+
+  // Adds the state reached with `switches` switches, the last step run by
+  // `thread`. Returns true if it's visited already, then its branch is
+  // explored, so the new one can be pruned. If the table is full, the new
+  // states are not added.
+  bool Visit(uint64_t fingerprint, size_t switches, size_t thread);
+
+  // Number of the calls of Visit(), and of them returned true.
+  size_t GetVisits() const { return shared->visits; }
+  size_t GetPruned() const { return shared->pruned; }
+
+ private:
+  static constexpr size_t kDefaultCapacity = size_t{1} << 24;
+
+  struct Entry {
+    // 0 means the entry is empty.
+    uint64_t fingerprint;
+    uint32_t switches;
+    uint32_t thread;
+  };
+
+  struct Shared {
+    size_t visits;
+    size_t pruned;
+    size_t size;
+  };
+
+  bool VisitExact(uint64_t fingerprint, size_t switches, size_t thread);
+  bool VisitApproximate(uint64_t fingerprint);
+
+  Mode mode;
+  // Number of the entries or the bits of the filter, a power of two.
+  size_t capacity;
+  size_t mapped_size;
+  Shared* shared;
+  Entry* entries{};
+  uint64_t* bits{};
+};
+
+}  // namespace ltest
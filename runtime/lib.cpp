@@ -1,6 +1,11 @@
 #include "include/lib.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -8,34 +13,133 @@
 #include "value_wrapper.h"
 
 // See comments in the lib.h.
-Task this_coro{};
-
-boost::context::fiber_context sched_ctx;
-std::optional<CoroutineStatus> coroutine_status;
-
-std::unordered_map<long, int> futex_state{};
+constinit thread_local size_t ltest_yield_budget = 0;
+constinit thread_local ltest::StepAccesses* ltest_step_accesses = nullptr;
 
 namespace ltest {
 std::vector<TaskBuilder> task_builders{};
+
+namespace {
+RuntimeContext default_runtime_context{};
+}  // namespace
+
+// See comments in the lib.h.
+constinit thread_local RuntimeContext* runtime_context =
+    &default_runtime_context;
+
+namespace {
+
+// Methods are registered during the static initialization, so the registry
+// is created on the first use. The names are kept in the deque, so the views
+// of them stay valid. Verifiers of the workers look methods up concurrently.
+struct MethodRegistry {
+  std::mutex mutex;
+  std::deque<std::string> names;
+  std::unordered_map<std::string_view, MethodId> ids;
+  std::atomic<size_t> count{};
+};
+
+MethodRegistry& GetMethodRegistry() {
+  static MethodRegistry registry;
+  return registry;
+}
+
+}  // namespace
+
+MethodId GetMethodId(std::string_view name) {
+  auto& registry = GetMethodRegistry();
+  std::lock_guard lock{registry.mutex};
+  if (auto it = registry.ids.find(name); it != registry.ids.end()) {
+    return it->second;
+  }
+  auto id = registry.names.size();
+  registry.names.emplace_back(name);
+  registry.ids.emplace(registry.names.back(), id);
+  registry.count.store(registry.names.size(), std::memory_order_release);
+  return id;
+}
+
+std::string_view GetMethodName(MethodId id) {
+  auto& registry = GetMethodRegistry();
+  std::lock_guard lock{registry.mutex};
+  assert(id < registry.names.size());
+  return registry.names[id];
+}
+
+size_t GetMethodsCount() {
+  return GetMethodRegistry().count.load(std::memory_order_acquire);
 }
 
-Task CoroBase::GetPtr() { return shared_from_this(); }
+bool FutexQueues::Wait(CoroBase* task, int* addr, int expected) {
+  assert(task->futex == nullptr);
+  if (*addr != expected) {
+    return false;
+  }
+  task->futex = addr;
+  // The queues outlive the round, so they are not in the round heap.
+  RoundHeapScope scope{false};
+  queues[addr].push_back(task);
+  return true;
+}
 
-void CoroBase::SetToken(std::shared_ptr<Token> token) { this->token = token; }
+size_t FutexQueues::Wake(int* addr, size_t count) {
+  auto it = queues.find(addr);
+  if (it == queues.end()) {
+    return 0;
+  }
+  auto& queue = it->second;
+  size_t woken = 0;
+  for (; woken < count && !queue.empty(); ++woken) {
+    queue.front()->futex = nullptr;
+    queue.pop_front();
+  }
+  return woken;
+}
 
-void CoroBase::Resume() {
-  this_coro = this->GetPtr();
-  assert(!this_coro->IsReturned() && this_coro->ctx);
-  boost::context::fiber_context([](boost::context::fiber_context&& ctx) {
-    sched_ctx = std::move(ctx);
-    this_coro->ctx = std::move(this_coro->ctx).resume();
-    return std::move(sched_ctx);
-  }).resume();
-  this_coro.reset();
+void FutexQueues::Remove(CoroBase* task) {
+  auto& queue = queues[task->futex];
+  auto it = std::find(queue.begin(), queue.end(), task);
+  assert(it != queue.end());
+  queue.erase(it);
+  task->futex = nullptr;
+}
+
+}  // namespace ltest
+
+void CoroBase::SetToken(std::shared_ptr<Token> token) {
+  this->token = token;
+  token->owner = this;
+}
+
+void CoroBase::Resume() { Resume(0); }
+
+size_t CoroBase::Resume(size_t yield_budget) {
+  assert(!IsReturned() && ctx.IsActive());
+  auto& runtime = ltest::GetRuntimeContext();
+  runtime.this_coro = this;
+  runtime.dropped_yield_budget = 0;
+  ltest_yield_budget = yield_budget;
+  ctx.Resume();
+  runtime.this_coro = nullptr;
+  auto yields =
+      yield_budget - ltest_yield_budget - runtime.dropped_yield_budget;
+  ltest_yield_budget = 0;
+  return yields;
 }
 
 int CoroBase::GetId() const { return id; }
 
+uint64_t CoroBase::GetArgsHash() const {
+  if (!args_hash.has_value()) {
+    uint64_t hash = 0;
+    for (auto& arg : GetStrArgs()) {
+      hash = ltest::MixSeed(hash ^ std::hash<std::string>{}(arg));
+    }
+    args_hash = hash;
+  }
+  return *args_hash;
+}
+
 ValueWrapper CoroBase::GetRetVal() const {
   assert(IsReturned());
   return ret;
@@ -43,28 +147,93 @@ ValueWrapper CoroBase::GetRetVal() const {
 
 bool CoroBase::IsParked() const { return token != nullptr && token->parked; }
 
+void CoroBase::Wake() {
+  Unblock();
+  if (token != nullptr) {
+    token->Reset();
+  }
+}
+
+void CoroBase::Unblock() {
+  if (futex != nullptr) {
+    ltest::GetRuntimeContext().futexes.Remove(this);
+  }
+}
+
+// Usually the coroutine is returned here, but the tasks blocked at the end of
+// the round are never resumed again and are destroyed suspended.
 CoroBase::~CoroBase() {
-  // The coroutine must be returned if we want to restart it.
-  // We can't just Terminate() it because it is the runtime responsibility to
-  // decide, in which order the tasks should be terminated.
-  assert(IsReturned());
+  Unblock();
+  // The target may keep the token longer than the task.
+  if (token != nullptr && token->owner == this) {
+    token->owner = nullptr;
+  }
 }
 
-std::string_view CoroBase::GetName() const { return name; }
+std::string_view CoroBase::GetName() const {
+  return ltest::GetMethodName(method_id);
+}
+
+ltest::MethodId CoroBase::GetMethodId() const { return method_id; }
 
 bool CoroBase::IsReturned() const { return is_returned; }
 
 extern "C" void CoroYield() {
-  assert(this_coro && sched_ctx);
-  boost::context::fiber_context([](boost::context::fiber_context&& ctx) {
-    this_coro->ctx = std::move(ctx);
-    return std::move(sched_ctx);
-  }).resume();
+  auto this_coro = ltest::GetRuntimeContext().this_coro;
+  if (this_coro == nullptr) {
+    // A suspended task is destroyed by unwinding its stack outside of the
+    // task, see TaskArena::Rewind(), so the destructors of its locals can't
+    // switch.
+    return;
+  }
+  // The scheduler allocates from malloc while the task is suspended.
+  ltest::RoundHeapScope scope{false};
+  this_coro->ctx.Suspend();
+}
+
+extern "C" void CoroYieldAccess(const void* address, size_t size, int kind) {
+  CoroAccess(address, size, kind);
+  CoroYield();
+}
+
+void ltest::StepAccesses::Merge(const StepAccesses& other) {
+  accesses.insert(accesses.end(), other.accesses.begin(),
+                  other.accesses.end());
+  is_reported = is_reported && other.is_reported;
+  is_unknown = is_unknown || other.is_unknown;
+}
+
+namespace {
+
+bool Overlap(const ltest::Access& a, const ltest::Access& b) {
+  if (a.size == 0 || b.size == 0) {
+    return true;
+  }
+  auto a_begin = reinterpret_cast<uintptr_t>(a.address);
+  auto b_begin = reinterpret_cast<uintptr_t>(b.address);
+  return a_begin < b_begin + b.size && b_begin < a_begin + a.size;
+}
+
+}  // namespace
+
+bool ltest::StepAccesses::ConflictsWith(const StepAccesses& other) const {
+  if (!is_reported || !other.is_reported || is_unknown || other.is_unknown) {
+    return true;
+  }
+  for (auto& a : accesses) {
+    for (auto& b : other.accesses) {
+      if ((a.kind != AccessKind::kRead || b.kind != AccessKind::kRead) &&
+          Overlap(a, b)) {
+        return true;
+      }
+    }
+  }
+  return false;
 }
 
 extern "C" void CoroutineStatusChange(char* name, bool start) {
   // assert(!coroutine_status.has_value());
-  coroutine_status.emplace(name, start);
+  ltest::GetRuntimeContext().coroutine_status.emplace(name, start);
   CoroYield();
 }
 
@@ -78,11 +247,28 @@ void CoroBase::Terminate() {
   }
 }
 
-void Token::Reset() { parked = false; }
+void Token::Reset() {
+  parked = false;
+  holder = nullptr;
+}
 
 void Token::Park() {
   parked = true;
   CoroYield();
 }
 
-void Token::Unpark() { parked = false; }
+void Token::Park(const Token& holder) {
+  this->holder = &holder;
+  Park();
+}
+
+void Token::Unpark() {
+  parked = false;
+  holder = nullptr;
+  // The unparked task may be picked now, so the strategy decides again at the
+  // next yield.
+  auto& runtime = ltest::GetRuntimeContext();
+  runtime.dropped_yield_budget += ltest_yield_budget;
+  ltest_yield_budget = 0;
+  ++runtime.wakeups;
+}
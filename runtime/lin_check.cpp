@@ -27,10 +27,10 @@ std::map<size_t, size_t> get_inv_res_mapping(
 }
 
 Invoke::Invoke(const Task &task, int thread_id)
-    : task(task), thread_id(thread_id) {}
+    : thread_id(thread_id), task(task) {}
 
 Response::Response(const Task &task, ValueWrapper result, int thread_id)
-    : task(task), result(result), thread_id(thread_id) {}
+    : result(result), thread_id(thread_id), task(task) {}
 
 const Task &Invoke::GetTask() const { return this->task; }
 
@@ -2,9 +2,11 @@
 
 #include <iostream>
 
-Logger l{};
+#include "include/lib.h"
 
-void logger_init(bool verbose) { l.verbose = verbose; }
+void logger_init(bool verbose) {
+  ltest::GetRuntimeContext().logger.verbose = verbose;
+}
 
 void Logger::flush() {
   if (verbose) {
@@ -12,4 +14,4 @@ void Logger::flush() {
   }
 }
 
-Logger& log() { return l; }
+Logger& log() { return ltest::GetRuntimeContext().logger; }
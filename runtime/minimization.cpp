@@ -99,7 +99,7 @@ StrategyExplorationMinimizor::StrategyExplorationMinimizor(int runs_)
 
 Scheduler::Result StrategyExplorationMinimizor::OnTasksRemoved(
     SchedulerWithReplay& sched,
-    const Scheduler::BothHistories& nonlinear_history,
+    const Scheduler::BothHistories& /*nonlinear_history*/,
     const std::unordered_set<int>& task_ids) const {
   auto mark_tasks_as_removed = [&](bool is_removed) {
     for (const auto& task_id : task_ids) {
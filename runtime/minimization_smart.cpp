@@ -4,19 +4,17 @@
 
 // smart minimizor
 SmartMinimizor::SmartMinimizor(int exploration_runs, int minimization_runs,
-                               PrettyPrinter& pretty_printer,
+                               PrettyPrinter& pretty_printer, uint64_t seed,
                                int max_offsprings_per_generation,
                                int offsprings_generation_attemps,
                                int initial_mutations_count)
     : exploration_runs(exploration_runs),
       minimization_runs(minimization_runs),
-      pretty_printer(pretty_printer),
       max_offsprings_per_generation(max_offsprings_per_generation),
       offsprings_generation_attemps(offsprings_generation_attemps),
-      mutations_count(initial_mutations_count) {
-  std::random_device dev;
-  rng = std::mt19937(dev());
-}
+      mutations_count(initial_mutations_count),
+      rng(seed),
+      pretty_printer(pretty_printer) {}
 
 void SmartMinimizor::Minimize(
     SchedulerWithReplay& sched,
@@ -44,7 +42,7 @@ void SmartMinimizor::Minimize(
       population.insert(s);
     }
 
-    while (population.size() > max_population_size) {
+    while (population.size() > static_cast<size_t>(max_population_size)) {
       population.erase(std::prev(population.end()));
     }
   }
@@ -77,9 +75,9 @@ void SmartMinimizor::DropRandomTask(
   auto& tasks = it->second;
 
   if (tasks.empty() ||
-      tasks.size() == 1 &&
-          threads.size() == 2  // removing task from selected thread will result
-                               // in single thread left
+      (tasks.size() == 1 &&
+       threads.size() == 2)  // removing task from selected thread will result
+                             // in single thread left
   )
     return;
 
@@ -133,7 +131,8 @@ std::vector<SmartMinimizor::Solution> SmartMinimizor::GenerateOffsprings(
 
   // This is an optimization which decreases the number of permitted mutations
   // over time when many unsuccessfull attempts to generate offspring are made.
-  if (offsprings.size() * 2 < max_offsprings_per_generation &&
+  if (offsprings.size() * 2 <
+          static_cast<size_t>(max_offsprings_per_generation) &&
       mutations_count > 1) {
     // update the mutations count
     mutations_count--;
@@ -147,11 +146,11 @@ void SmartMinimizor::RemoveInvalidTasks(
     const std::unordered_map<int, std::unordered_set<int>>& valid_threads)
     const {
   const auto& tasks = strategy.GetTasks();
-  for (int thread_id = 0; thread_id < tasks.size(); ++thread_id) {
+  for (size_t thread_id = 0; thread_id < tasks.size(); ++thread_id) {
     const auto& thread = tasks[thread_id];
     bool thread_exists = valid_threads.contains(thread_id);
 
-    for (int i = 0; i < thread.size(); ++i) {
+    for (size_t i = 0; i < thread.size(); ++i) {
       if (thread_exists &&
           valid_threads.at(thread_id).contains(thread[i]->GetId())) {
         strategy.SetTaskRemoved(thread[i]->GetId(), false);
@@ -163,7 +162,8 @@ void SmartMinimizor::RemoveInvalidTasks(
 }
 
 std::unordered_map<int, std::unordered_set<int>> SmartMinimizor::CrossProduct(
-    const Strategy& strategy, const Solution* p1, const Solution* p2) const {
+    const Strategy& /*strategy*/, const Solution* p1,
+    const Solution* p2) const {
   // p1 has smaller number of threads
   if (p1->tasks.size() >= p2->tasks.size()) {
     std::swap(p1, p2);
@@ -204,9 +204,9 @@ SmartMinimizor::Solution::Solution(const Strategy& strategy,
 
   // save valid task ids per thread
   const auto& threads = strategy.GetTasks();
-  for (int i = 0; i < threads.size(); ++i) {
-    for (int j = 0; j < threads[i].size(); ++j) {
-      const auto& task = threads[i][j].get();
+  for (size_t i = 0; i < threads.size(); ++i) {
+    for (size_t j = 0; j < threads[i].size(); ++j) {
+      const auto& task = threads[i][j];
 
       if (!strategy.IsTaskRemoved(task->GetId())) {
         valid_tasks++;
@@ -0,0 +1,119 @@
+#include "include/round_heap.h"
+
+#include <sys/mman.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+#include <system_error>
+
+namespace ltest {
+
+// See comments in the round_heap.h.
+constinit thread_local RoundHeap* round_heap = nullptr;
+
+RoundHeap::RoundHeap(size_t capacity) : capacity(capacity) {
+  // The pages are committed on the first touch, and the rewound ones are
+  // reused, so the memory is bounded by the largest round.
+  void* vp = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (vp == MAP_FAILED) {
+    throw std::system_error(errno, std::generic_category(), "mmap");
+  }
+  base = static_cast<std::byte*>(vp);
+}
+
+RoundHeap::~RoundHeap() { ::munmap(base, capacity); }
+
+}  // namespace ltest
+
+namespace {
+
+void* Allocate(size_t size, size_t alignment) {
+  auto heap = ltest::round_heap;
+  if (heap != nullptr && heap->active) {
+    if (void* ptr = heap->Allocate(size, alignment)) {
+      return ptr;
+    }
+  }
+  if (size == 0) {
+    size = 1;
+  }
+  void* ptr = alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__
+                  ? std::malloc(size)
+                  : std::aligned_alloc(alignment,
+                                       (size + alignment - 1) & ~(alignment - 1));
+  if (ptr == nullptr) {
+    throw std::bad_alloc{};
+  }
+  return ptr;
+}
+
+void Deallocate(void* ptr) noexcept {
+  auto heap = ltest::round_heap;
+  if (heap != nullptr && heap->Owns(ptr)) {
+    return;
+  }
+  std::free(ptr);
+}
+
+}  // namespace
+
+// The replaceable allocation functions go to the round heap of the thread
+// while a task runs, see ltest::RoundHeap.
+
+void* operator new(size_t size) {
+  return Allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void* operator new[](size_t size) {
+  return Allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+  return Allocate(size, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+  return Allocate(size, static_cast<size_t>(alignment));
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return Allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return Allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+  } catch (const std::bad_alloc&) {
+    return nullptr;
+  }
+}
+
+void operator delete(void* ptr) noexcept { Deallocate(ptr); }
+
+void operator delete[](void* ptr) noexcept { Deallocate(ptr); }
+
+void operator delete(void* ptr, size_t) noexcept { Deallocate(ptr); }
+
+void operator delete[](void* ptr, size_t) noexcept { Deallocate(ptr); }
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+  Deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+  Deallocate(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+  Deallocate(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+  Deallocate(ptr);
+}
@@ -0,0 +1,132 @@
+#include "include/stack_pool.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <new>
+
+namespace ltest {
+
+namespace {
+
+constexpr size_t kDefaultStackSize = 128 * 1024;
+constexpr size_t kMinStackSize = 16 * 1024;
+
+// Transparent huge pages are used only for 2MB aligned chunks, so huge stacks
+// are aligned to this size and rounded up to it.
+constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+size_t RoundUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+size_t PageSize() {
+  static const size_t page_size = ::sysconf(_SC_PAGESIZE);
+  return page_size;
+}
+
+}  // namespace
+
+void StackPool::Configure(size_t stack_size, size_t preallocate,
+                          bool huge_pages) {
+  Clear();
+  if (stack_size == 0) {
+    stack_size = kDefaultStackSize;
+  }
+  stack_size = std::max(stack_size, kMinStackSize);
+  this->stack_size =
+      RoundUp(stack_size, huge_pages ? kHugePageSize : PageSize());
+  this->huge_pages = huge_pages;
+  stats = Stats{};
+
+  free_stacks.reserve(preallocate);
+  for (size_t i = 0; i < preallocate; ++i) {
+    free_stacks.push_back(Map());
+  }
+}
+
+StackContext StackPool::Allocate() {
+  if (stack_size == 0) {
+    // Not configured, use the defaults.
+    Configure(0, 0, false);
+  }
+  if (free_stacks.empty()) {
+    ++stats.misses;
+    return Map();
+  }
+  ++stats.hits;
+  auto sctx = free_stacks.back();
+  free_stacks.pop_back();
+  return sctx;
+}
+
+void StackPool::Deallocate(StackContext& sctx) noexcept {
+  if (sctx.size != stack_size + PageSize()) {
+    // The stack was mapped before the pool was reconfigured.
+    Unmap(sctx);
+    return;
+  }
+  free_stacks.push_back(sctx);
+}
+
+StackPool::Stats StackPool::GetStats() const { return stats; }
+
+StackPool::~StackPool() { Clear(); }
+
+StackContext StackPool::Map() const {
+  const size_t page_size = PageSize();
+  // One more page at the bottom is used as the guard page.
+  const size_t size = stack_size + page_size;
+  // The huge stack is aligned to the huge page, so more is mapped and the
+  // rest around the aligned stack and its guard page is unmapped.
+  const size_t mapped = huge_pages ? size + kHugePageSize : size;
+  void* vp = ::mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+  if (vp == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  if (huge_pages) {
+    auto begin = reinterpret_cast<uintptr_t>(vp);
+    auto stack = RoundUp(begin + page_size, kHugePageSize);
+    auto end = begin + mapped;
+    if (stack - page_size > begin) {
+      ::munmap(vp, stack - page_size - begin);
+    }
+    if (end > stack + stack_size) {
+      ::munmap(reinterpret_cast<void*>(stack + stack_size),
+               end - stack - stack_size);
+    }
+    vp = reinterpret_cast<void*>(stack - page_size);
+    // It's only a hint, the kernel is free to ignore it.
+    ::madvise(reinterpret_cast<void*>(stack), stack_size, MADV_HUGEPAGE);
+  }
+  [[maybe_unused]] int res = ::mprotect(vp, page_size, PROT_NONE);
+  assert(res == 0);
+
+  StackContext sctx;
+  sctx.size = size;
+  sctx.sp = static_cast<char*>(vp) + size;
+  return sctx;
+}
+
+void StackPool::Unmap(StackContext& sctx) const noexcept {
+  void* vp = static_cast<char*>(sctx.sp) - sctx.size;
+  ::munmap(vp, sctx.size);
+}
+
+void StackPool::Clear() noexcept {
+  for (auto& sctx : free_stacks) {
+    Unmap(sctx);
+  }
+  free_stacks.clear();
+}
+
+StackPool& GetStackPool() {
+  thread_local StackPool pool{};
+  return pool;
+}
+
+}  // namespace ltest
@@ -0,0 +1,53 @@
+#include "include/task_arena.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "include/lib.h"
+
+namespace ltest {
+
+namespace {
+
+constexpr size_t kChunkSize = 64 * 1024;
+
+size_t AlignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace
+
+void* TaskArena::Allocate(size_t size, size_t alignment) {
+  assert(alignment <= alignof(std::max_align_t));
+  while (chunk < chunks.size()) {
+    auto begin = AlignUp(offset, alignment);
+    if (begin + size <= chunks[chunk].size) {
+      offset = begin + size;
+      return chunks[chunk].data.get() + begin;
+    }
+    // Rest of the chunk is wasted, go to the next one.
+    ++chunk;
+    offset = 0;
+  }
+  auto chunk_size = std::max(kChunkSize, size);
+  chunks.push_back(
+      Chunk{std::make_unique<std::byte[]>(chunk_size), chunk_size});
+  chunk = chunks.size() - 1;
+  offset = size;
+  return chunks.back().data.get();
+}
+
+void TaskArena::Rewind(Mark mark) {
+  assert(mark <= tasks.size());
+  while (tasks.size() > mark) {
+    auto& entry = tasks.back();
+    entry.task->~CoroBase();
+    chunk = entry.pos.chunk;
+    offset = entry.pos.offset;
+    tasks.pop_back();
+  }
+}
+
+TaskArena::~TaskArena() { Clear(); }
+
+}  // namespace ltest
@@ -0,0 +1,180 @@
+#include "include/task_terminator.h"
+
+#include <algorithm>
+
+#include "include/logger.h"
+
+namespace ltest {
+
+namespace {
+
+// Yields a task makes per resume, so the tasks spinning on each other switch.
+constexpr size_t kYieldBudget = 1024;
+
+// Yields the tasks may make without any of them returning before they are
+// considered spinning on each other. The waits of a deadlock are found in the
+// graph, so only the tasks that spin without waiting reach the limit.
+constexpr size_t kSpinLimit = 10'000'000;
+
+bool IsWaiting(Task task) { return task->IsParked() || task->IsBlocked(); }
+
+}  // namespace
+
+Task TaskTerminator::Head(size_t thread) {
+  auto& tasks = threads[thread];
+  auto& head = heads[thread];
+  while (head < tasks.size() && tasks[head]->IsReturned()) {
+    ++head;
+  }
+  return head < tasks.size() ? tasks[head] : nullptr;
+}
+
+std::vector<size_t> TaskTerminator::BuildGraph() {
+  waits_for.assign(threads_count, kNone);
+  for (size_t i = 0; i < threads_count; ++i) {
+    auto task = Head(i);
+    if (task == nullptr || !task->IsParked()) {
+      continue;
+    }
+    auto holder = task->GetToken()->GetHolder();
+    if (holder == nullptr) {
+      continue;
+    }
+    for (size_t j = 0; j < threads_count; ++j) {
+      if (Head(j) == holder->GetOwner()) {
+        waits_for[i] = j;
+        break;
+      }
+    }
+  }
+
+  // A task waits for at most one other, so a cycle is found by following
+  // the waits from every task, 1 marks the threads of the current path.
+  std::vector<int> state(threads_count);
+  std::vector<size_t> path;
+  for (size_t i = 0; i < threads_count; ++i) {
+    path.clear();
+    size_t thread = i;
+    while (thread != kNone && state[thread] == 0) {
+      state[thread] = 1;
+      path.push_back(thread);
+      thread = waits_for[thread];
+    }
+    if (thread != kNone && state[thread] == 1) {
+      return {std::find(path.begin(), path.end(), thread), path.end()};
+    }
+    for (auto t : path) {
+      state[t] = 2;
+    }
+  }
+  return {};
+}
+
+void TaskTerminator::SortRunnable() {
+  // Number of the tasks that wait for the thread through the others.
+  std::vector<size_t> waiters(threads_count);
+  order.clear();
+  for (size_t i = 0; i < threads_count; ++i) {
+    auto task = Head(i);
+    if (task == nullptr) {
+      continue;
+    }
+    if (!IsWaiting(task)) {
+      order.push_back(i);
+      continue;
+    }
+    // There is no cycle, so the waits end at a task that doesn't wait for a
+    // known one.
+    size_t thread = i;
+    while (waits_for[thread] != kNone) {
+      thread = waits_for[thread];
+    }
+    ++waiters[thread];
+  }
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return waiters[a] > waiters[b];
+  });
+}
+
+size_t TaskTerminator::Terminate(const std::function<void()>& reset) {
+  heads.assign(threads_count, 0);
+  bool is_reset = false;
+  size_t yields = 0;
+  size_t left = 0;
+
+  while (true) {
+    bool has_unfinished = false;
+    for (size_t i = 0; i < threads_count && !has_unfinished; ++i) {
+      has_unfinished = Head(i) != nullptr;
+    }
+    if (!has_unfinished) {
+      break;
+    }
+
+    auto cycle = BuildGraph();
+    if (cycle.empty()) {
+      SortRunnable();
+      if (!order.empty() && yields < kSpinLimit) {
+        for (auto i : order) {
+          auto task = Head(i);
+          yields += task->Resume(kYieldBudget) + 1;
+          if (task->IsReturned()) {
+            yields = 0;
+          }
+        }
+        continue;
+      }
+    }
+
+    if (is_reset) {
+      // The tasks and the rest of their threads are destroyed suspended.
+      for (size_t i = 0; i < threads_count; ++i) {
+        if (Head(i) != nullptr) {
+          left += threads[i].size() - heads[i];
+        }
+      }
+      break;
+    }
+    ReportDeadlock(cycle);
+    reset();
+    is_reset = true;
+    yields = 0;
+    for (size_t i = 0; i < threads_count; ++i) {
+      if (auto task = Head(i); task != nullptr) {
+        task->Wake();
+      }
+    }
+  }
+
+  threads_count = 0;
+  return left;
+}
+
+void TaskTerminator::ReportDeadlock(const std::vector<size_t>& cycle) {
+  log() << "deadlock while terminating the tasks:\n";
+  for (size_t i = 0; i < threads_count; ++i) {
+    auto task = Head(i);
+    if (task == nullptr) {
+      continue;
+    }
+    log() << "  thread " << i << ": " << task->GetName() << " (task "
+          << task->GetId() << ") is ";
+    if (waits_for[i] != kNone) {
+      log() << "parked behind thread " << waits_for[i] << "\n";
+    } else {
+      log() << (task->IsParked()    ? "parked"
+                : task->IsBlocked() ? "blocked on a futex"
+                                    : "spinning")
+            << "\n";
+    }
+  }
+  if (!cycle.empty()) {
+    log() << "  cycle:";
+    for (auto thread : cycle) {
+      log() << " thread " << thread << " ->";
+    }
+    log() << " thread " << cycle.front() << "\n";
+  }
+}
+
+}  // namespace ltest
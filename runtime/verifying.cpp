@@ -1,9 +1,18 @@
 #include "verifying.h"
 
 #include <gflags/gflags.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <random>
 #include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <vector>
 
 namespace ltest {
 
@@ -14,7 +23,7 @@ std::string toString<int>(const int &a) {
 
 template <>
 std::string toString<std::shared_ptr<Token>>(
-    const std::shared_ptr<Token> &token) {
+    const std::shared_ptr<Token> & /*token*/) {
   return "token";
 }
 
@@ -46,7 +55,11 @@ constexpr const char *GetLiteral(StrategyType t) {
       return "tla";
     case PCT:
       return "pct";
+    case DPOR:
+      return "dpor";
   }
+  assert(false && "unknown strategy type");
+  return "";
 }
 
 StrategyType FromLiteral(std::string &&a) {
@@ -58,6 +71,8 @@ StrategyType FromLiteral(std::string &&a) {
     return StrategyType::RR;
   } else if (a == GetLiteral(StrategyType::TLA)) {
     return StrategyType::TLA;
+  } else if (a == GetLiteral(StrategyType::DPOR)) {
+    return StrategyType::DPOR;
   } else {
     throw std::invalid_argument(a);
   }
@@ -74,13 +89,49 @@ DEFINE_int32(exploration_runs, 15,
 DEFINE_int32(minimization_runs, 15,
              "Number of minimization runs for smart minimizor");
 DEFINE_int32(depth, 0,
-              "How many tasks can be executed on one thread(Only for TLA)");
+              "How many tasks can be executed on one thread(Only for TLA and "
+              "DPOR)");
 DEFINE_bool(verbose, false, "Verbosity");
 DEFINE_bool(
     forbid_all_same, false,
     "forbid scenarios that execute tasks with same name at all threads");
 DEFINE_string(strategy, GetLiteral(StrategyType::RR), "Strategy");
 DEFINE_string(weights, "", "comma-separated list of weights for threads");
+DEFINE_int32(stack_size, 0, "Size of the task stack in bytes (0 means 128KiB)");
+DEFINE_int32(stack_pool, 0, "Number of task stacks to map on startup");
+DEFINE_bool(huge_pages, false,
+            "Align the task stacks to 2MB huge pages and advise the kernel "
+            "to back them with huge pages");
+DEFINE_bool(shared_stack, false,
+            "Run all tasks on one stack of stack_size bytes, copying the used "
+            "part of it on switches (only for the asm context backend)");
+DEFINE_int32(workers, 1,
+             "Number of threads exploring the rounds in parallel, each with "
+             "its own target object (not for TLA)");
+DEFINE_bool(round_heap, false,
+            "Allocate the memory of the target during a round from a heap "
+            "rewound between the rounds, TargetObj::Reset() is not needed");
+DEFINE_int32(checkpoint_depth, 0,
+             "Explore the branches of the TLA steps from this depth in forked "
+             "processes instead of replaying the steps (0 disables)");
+DEFINE_int32(checkpoint_stride, 4,
+             "Fork at every this many TLA steps from the checkpoint depth, "
+             "the branches of the steps between them are replayed");
+DEFINE_bool(symmetry, false,
+            "Explore only one of the TLA threads with the same tasks if all "
+            "generators are declared without thread_num");
+DEFINE_string(prune_states, "",
+              "Prune the TLA branches that reach a visited state, the target "
+              "needs StateHash(): exact or approximate (a Bloom filter)");
+DEFINE_int32(fork_batch, 0,
+             "Run the rounds in forked children, N rounds each, and go on "
+             "with the next child when one crashes (0 disables, not for TLA)");
+DEFINE_uint64(seed, 0,
+              "Seed of the random choices, the seed and the round index "
+              "determine the round (0 picks a random seed)");
+DEFINE_int64(replay_round, -1,
+             "Run only the round with this index of the seed, e.g. the one "
+             "a nonlinearizable history was found in (not for TLA)");
 
 void SetOpts(const DefaultOptions &def) {
   FLAGS_threads = def.threads;
@@ -119,7 +170,279 @@ Opts ParseOpts() {
     }
   }
   opts.thread_weights = std::move(thread_weights);
+  if (FLAGS_stack_size < 0) {
+    throw std::invalid_argument{"stack size must be non-negative"};
+  }
+  opts.stack_size = FLAGS_stack_size;
+  if (FLAGS_stack_pool < 0) {
+    throw std::invalid_argument{"stack pool must be non-negative"};
+  }
+  opts.stack_pool = FLAGS_stack_pool;
+  opts.huge_pages = FLAGS_huge_pages;
+  if (FLAGS_shared_stack && !CoroContext::kSupportsSharedStack) {
+    throw std::invalid_argument{
+        "shared stack is supported only by the asm context backend"};
+  }
+  opts.shared_stack = FLAGS_shared_stack;
+  if (FLAGS_workers < 1) {
+    throw std::invalid_argument{"number of workers must be positive"};
+  }
+  opts.workers = FLAGS_workers;
+  opts.round_heap = FLAGS_round_heap;
+  if (FLAGS_checkpoint_depth < 0) {
+    throw std::invalid_argument{"checkpoint depth must be non-negative"};
+  }
+  opts.checkpoint_depth = FLAGS_checkpoint_depth;
+  if (FLAGS_checkpoint_stride < 1) {
+    throw std::invalid_argument{"checkpoint stride must be positive"};
+  }
+  opts.checkpoint_stride = FLAGS_checkpoint_stride;
+  opts.symmetry = FLAGS_symmetry;
+  if (FLAGS_prune_states == "exact") {
+    opts.prune_states = VisitedStates::Mode::kExact;
+  } else if (FLAGS_prune_states == "approximate") {
+    opts.prune_states = VisitedStates::Mode::kApproximate;
+  } else if (!FLAGS_prune_states.empty()) {
+    throw std::invalid_argument{"unknown mode of pruning the states"};
+  }
+  if (opts.prune_states.has_value() && opts.typ != TLA) {
+    throw std::invalid_argument{"only tla prunes the states"};
+  }
+  // The exhaustive schedulers explore one tree of the executions.
+  bool is_exhaustive = opts.typ == TLA || opts.typ == DPOR;
+  if (opts.workers > 1 && is_exhaustive) {
+    throw std::invalid_argument{std::string{GetLiteral(opts.typ)} +
+                                " doesn't support several workers"};
+  }
+  if (FLAGS_fork_batch < 0) {
+    throw std::invalid_argument{"fork batch must be non-negative"};
+  }
+  opts.fork_batch = FLAGS_fork_batch;
+  if (opts.fork_batch != 0 && is_exhaustive) {
+    throw std::invalid_argument{std::string{GetLiteral(opts.typ)} +
+                                " doesn't support the fork server"};
+  }
+  opts.seed = FLAGS_seed;
+  if (opts.seed == 0) {
+    opts.seed = std::random_device{}();
+  }
+  if (FLAGS_replay_round >= 0) {
+    if (is_exhaustive) {
+      throw std::invalid_argument{std::string{GetLiteral(opts.typ)} +
+                                  " doesn't support replaying a round"};
+    }
+    opts.first_round = FLAGS_replay_round;
+    opts.rounds = 1;
+    opts.workers = 1;
+    opts.fork_batch = 0;
+  }
   return opts;
 }
 
+void PrintStrategy(StrategyType typ) {
+  switch (typ) {
+    case RR:
+      std::cout << "round-robin\n";
+      break;
+    case RND:
+      std::cout << "random\n";
+      break;
+    case PCT:
+      std::cout << "pct\n";
+      break;
+    case TLA:
+      std::cout << "tla\n";
+      break;
+    case DPOR:
+      std::cout << "dpor\n";
+      break;
+  }
+}
+
+namespace {
+
+// Result of a batch the child writes to the pipe.
+struct BatchReport {
+  int result;
+  StackPool::Stats stack_stats;
+  // The child writes only the round from the crash handler.
+  bool crashed;
+  size_t round;
+};
+
+// Write end of the pipe of the forked child, see ReportCrash().
+int report_fd = -1;
+
+// Reports the round the thread has crashed in and lets the signal kill the
+// child.
+void ReportCrash(int sig) {
+  BatchReport report{};
+  report.crashed = true;
+  report.round = GetRuntimeContext().round;
+  [[maybe_unused]] auto written = ::write(report_fd, &report, sizeof(report));
+  std::signal(sig, SIG_DFL);
+  std::raise(sig);
+}
+
+// Alternate signal stack of a thread, the crash handler runs on it, so a
+// stack overflow of a coroutine is reported too.
+class CrashSignalStack {
+ public:
+  CrashSignalStack() : memory(kSize) {
+    stack_t stack{};
+    stack.ss_sp = memory.data();
+    stack.ss_size = memory.size();
+    if (::sigaltstack(&stack, nullptr) == -1) {
+      throw std::system_error(errno, std::generic_category(), "sigaltstack");
+    }
+  }
+
+  ~CrashSignalStack() {
+    stack_t stack{};
+    stack.ss_flags = SS_DISABLE;
+    ::sigaltstack(&stack, nullptr);
+  }
+
+ private:
+  // SIGSTKSZ isn't a constant in the recent glibc.
+  static constexpr size_t kSize = 64 << 10;
+  std::vector<char> memory;
+};
+
+// Installs the crash handler in the forked child.
+void InstallCrashHandler() {
+  SetCrashSignalStack();
+  struct sigaction action{};
+  action.sa_handler = ReportCrash;
+  action.sa_flags = SA_ONSTACK;
+  sigemptyset(&action.sa_mask);
+  for (int sig : {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT}) {
+    ::sigaction(sig, &action, nullptr);
+  }
+}
+
+// Reads the report, returns false if the child has died before writing it.
+bool ReadReport(int fd, BatchReport &report) {
+  auto data = reinterpret_cast<char *>(&report);
+  size_t size = 0;
+  while (size < sizeof(report)) {
+    auto n = ::read(fd, data + size, sizeof(report) - size);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    size += n;
+  }
+  return true;
+}
+
+}  // namespace
+
+void SetCrashSignalStack() {
+  if (report_fd == -1) {
+    return;
+  }
+  thread_local CrashSignalStack stack;
+}
+
+int RunForkServer(
+    const Opts &opts,
+    const std::function<int(const Opts &, StackPool::Stats &)> &run_batch,
+    StackPool::Stats &stack_stats) {
+  size_t crashes = 0;
+  auto batch_opts = opts;
+  // Rounds [first, last) of the batch left to run after the crashes, the
+  // earliest range is at the back.
+  std::vector<std::pair<size_t, size_t>> pending;
+  for (size_t done = 0; done < opts.rounds || !pending.empty();) {
+    if (pending.empty()) {
+      auto rounds = std::min(opts.fork_batch, opts.rounds - done);
+      pending.emplace_back(opts.first_round + done,
+                           opts.first_round + done + rounds);
+      done += rounds;
+    }
+    auto [first, last] = pending.back();
+    pending.pop_back();
+    batch_opts.first_round = first;
+    batch_opts.rounds = last - first;
+
+    int fds[2];
+    if (::pipe(fds) == -1) {
+      throw std::system_error(errno, std::generic_category(), "pipe");
+    }
+    std::cout.flush();
+    auto child = ::fork();
+    if (child == -1) {
+      throw std::system_error(errno, std::generic_category(), "fork");
+    }
+    if (child == 0) {
+      ::close(fds[0]);
+      report_fd = fds[1];
+      InstallCrashHandler();
+      BatchReport report{};
+      report.result = run_batch(batch_opts, report.stack_stats);
+      std::cout.flush();
+      auto written = ::write(fds[1], &report, sizeof(report));
+      ::_exit(written == sizeof(report) ? 0 : 1);
+    }
+
+    ::close(fds[1]);
+    BatchReport report{};
+    bool reported = ReadReport(fds[0], report);
+    ::close(fds[0]);
+    int status;
+    while (::waitpid(child, &status, 0) == -1) {
+      if (errno != EINTR) {
+        throw std::system_error(errno, std::generic_category(), "waitpid");
+      }
+    }
+
+    bool exited = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (!reported || report.crashed || !exited) {
+      ++crashes;
+      std::cout << "rounds " << batch_opts.first_round << ".."
+                << batch_opts.first_round + batch_opts.rounds - 1
+                << " crashed";
+      if (report.crashed) {
+        std::cout << " at round " << report.round;
+      }
+      if (WIFSIGNALED(status)) {
+        std::cout << ": " << ::strsignal(WTERMSIG(status)) << "\n";
+      } else {
+        std::cout << ": exit code " << WEXITSTATUS(status) << "\n";
+      }
+      if (report.crashed && first <= report.round && report.round < last) {
+        // The next child skips only the crashed round. The workers run
+        // their parts of the batch at once, so the rounds before it are run
+        // again if there are several of them.
+        if (report.round + 1 < last) {
+          pending.emplace_back(report.round + 1, last);
+        }
+        if (opts.workers > 1 && first < report.round) {
+          pending.emplace_back(first, report.round);
+        }
+      } else if (last - first > 1) {
+        // The crashed round is unknown, the halves of the batch are run
+        // again until the crash is narrowed down to a single round.
+        auto middle = first + (last - first) / 2;
+        pending.emplace_back(middle, last);
+        pending.emplace_back(first, middle);
+      }
+      continue;
+    }
+    stack_stats.hits += report.stack_stats.hits;
+    stack_stats.misses += report.stack_stats.misses;
+    if (report.result != 0) {
+      return 1;
+    }
+  }
+  if (crashes != 0) {
+    std::cout << "crashed batches: " << crashes << "\n";
+    return 1;
+  }
+  return 0;
+}
+
 }  // namespace ltest
@@ -0,0 +1,101 @@
+#include "include/visited_states.h"
+
+#include <sys/mman.h>
+
+#include <cerrno>
+#include <system_error>
+
+#include "include/lib.h"
+
+namespace ltest {
+
+namespace {
+
+// Number of the bits of the filter set for a state.
+constexpr size_t kBloomHashes = 4;
+
+}  // namespace
+
+VisitedStates::VisitedStates(Mode mode, size_t capacity)
+    : mode(mode), capacity(capacity) {
+  size_t table_size = mode == Mode::kExact ? capacity * sizeof(Entry)
+                                           : capacity / 8;
+  mapped_size = sizeof(Shared) + table_size;
+  // The pages are committed on the first touch.
+  void* vp = ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (vp == MAP_FAILED) {
+    throw std::system_error(errno, std::generic_category(), "mmap");
+  }
+  shared = static_cast<Shared*>(vp);
+  auto table = static_cast<void*>(shared + 1);
+  if (mode == Mode::kExact) {
+    entries = static_cast<Entry*>(table);
+  } else {
+    bits = static_cast<uint64_t*>(table);
+  }
+}
+
+VisitedStates::~VisitedStates() { ::munmap(shared, mapped_size); }
+
+bool VisitedStates::Visit(uint64_t fingerprint, size_t switches,
+                          size_t thread) {
+  ++shared->visits;
+  bool is_visited =
+      mode == Mode::kExact
+          ? VisitExact(fingerprint, switches, thread)
+          : VisitApproximate(fingerprint ^
+                             MixSeed((uint64_t{switches} << 32) ^ thread));
+  if (is_visited) {
+    ++shared->pruned;
+  }
+  return is_visited;
+}
+
+bool VisitedStates::VisitExact(uint64_t fingerprint, size_t switches,
+                               size_t thread) {
+  if (fingerprint == 0) {
+    fingerprint = 1;
+  }
+  for (size_t i = fingerprint & (capacity - 1);; i = (i + 1) & (capacity - 1)) {
+    auto& entry = entries[i];
+    if (entry.fingerprint == 0) {
+      // Half of the table is kept empty, so the probes stay short.
+      if (shared->size * 2 >= capacity) {
+        return false;
+      }
+      ++shared->size;
+      entry = Entry{fingerprint, static_cast<uint32_t>(switches),
+                    static_cast<uint32_t>(thread)};
+      return false;
+    }
+    if (entry.fingerprint != fingerprint) {
+      continue;
+    }
+    // The next switch may cost one more after another thread.
+    if (entry.switches + (entry.thread != thread) <= switches) {
+      return true;
+    }
+    if (switches < entry.switches) {
+      entry.switches = switches;
+      entry.thread = thread;
+    }
+    return false;
+  }
+}
+
+bool VisitedStates::VisitApproximate(uint64_t key) {
+  auto step = MixSeed(key) | 1;
+  bool is_visited = true;
+  for (size_t i = 0; i < kBloomHashes; ++i) {
+    auto bit = (key + i * step) & (capacity - 1);
+    auto mask = uint64_t{1} << (bit % 64);
+    if ((bits[bit / 64] & mask) == 0) {
+      is_visited = false;
+      bits[bit / 64] |= mask;
+    }
+  }
+  return is_visited;
+}
+
+}  // namespace ltest
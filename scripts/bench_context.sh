@@ -0,0 +1,12 @@
+#!/usr/bin/env bash
+# Builds the runtime with every context switch backend and compares them.
+# Usage: scripts/bench_context.sh [contexts] [switches]
+set -e
+for backend in boost asm ucontext; do
+    dir=build-bench-$backend
+    cmake -G Ninja -B $dir -DCMAKE_BUILD_TYPE=Release \
+        -DLTEST_CONTEXT_BACKEND=$backend >/dev/null
+    cmake --build $dir --target context_switch_bench >/dev/null
+    ./$dir/test/bench/context_switch_bench "$@"
+    echo
+done
@@ -1,4 +1,5 @@
 #include <libsyscall_intercept_hook_point.h>
+#include <errno.h>
 #include <linux/futex.h>
 #include <sys/syscall.h>
 #include <syscall.h>
@@ -13,7 +14,8 @@ hook(long syscall_number,
 			long arg4, long arg5,
 			long *result)
 {
-	if (!__trap_syscall) {
+	auto &runtime = ltest::GetRuntimeContext();
+	if (!runtime.trap_syscall) {
 		return 1;
 	}
 	if (syscall_number == SYS_sched_yield) {
@@ -22,10 +24,16 @@ hook(long syscall_number,
 		return 0;
 	} else if (syscall_number == SYS_futex) {
 		debug(stderr, "caught futex(0x%lx, %ld, %ld)\n", (unsigned long)arg0, arg1, arg2);
+		auto addr = reinterpret_cast<int *>(arg0);
 		if (arg1 == FUTEX_WAIT_PRIVATE) {
-			this_coro->SetBlocked(arg0, arg2);
+			bool blocked = runtime.futexes.Wait(runtime.this_coro, addr,
+							    static_cast<int>(arg2));
+			*result = blocked ? 0 : -EAGAIN;
 		} else if (arg1 == FUTEX_WAKE_PRIVATE) {
-			
+			*result = runtime.futexes.Wake(addr, arg2);
+			if (*result > 0) {
+				++runtime.wakeups;
+			}
 		} else {
 			assert(false && "unsupported futex call");
 		}
@@ -0,0 +1,95 @@
+// Measures the context switches per second of the task context backend the
+// runtime is built with.
+//
+// Usage: context_switch_bench [contexts] [switches] [shared]
+// Resumes `contexts` contexts in round robin order until `switches` switches
+// (both directions) are made. Each context suspends kStepsPerRun times and
+// returns, then it is restarted, so the start cost is measured too.
+// If `shared` is 1, the contexts run on the shared stack (asm backend only).
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "coro_context.h"
+
+namespace {
+
+constexpr long kStepsPerRun = 1000;
+
+struct Yielder {
+  ltest::CoroContext ctx;
+  long steps_left;
+};
+
+void YielderMain(void* arg) {
+  auto y = static_cast<Yielder*>(arg);
+  while (y->steps_left-- > 0) {
+    y->ctx.Suspend();
+  }
+}
+
+std::string Backend() {
+#if defined(LTEST_CONTEXT_ASM)
+  return "asm";
+#elif defined(LTEST_CONTEXT_UCONTEXT)
+  return "ucontext";
+#else
+  return "boost";
+#endif
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  size_t contexts = argc > 1 ? std::atol(argv[1]) : 100;
+  long switches = argc > 2 ? std::atol(argv[2]) : 10'000'000;
+  bool shared = argc > 3 && std::atol(argv[3]) == 1;
+  ltest::CoroContext::SetSharedStack(shared);
+
+  std::vector<std::unique_ptr<Yielder>> yielders;
+  for (size_t i = 0; i < contexts; ++i) {
+    yielders.push_back(std::make_unique<Yielder>());
+  }
+  auto start = [](Yielder* y) {
+    y->steps_left = kStepsPerRun;
+    y->ctx.Start(&YielderMain, y);
+  };
+  for (auto& y : yielders) {
+    start(y.get());
+  }
+
+  long made = 0;
+  long restarts = 0;
+  auto begin = std::chrono::steady_clock::now();
+  while (made < switches) {
+    for (auto& y : yielders) {
+      if (!y->ctx.IsActive()) {
+        start(y.get());
+        ++restarts;
+      }
+      y->ctx.Resume();
+      made += 2;
+    }
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - begin;
+
+  // Let the contexts return, so their stacks are released.
+  for (auto& y : yielders) {
+    y->steps_left = 0;
+    while (y->ctx.IsActive()) {
+      y->ctx.Resume();
+    }
+  }
+
+  std::cout << "backend: " << Backend() << (shared ? ", shared stack" : "")
+            << "\n";
+  std::cout << "contexts: " << contexts << ", switches: " << made
+            << ", restarts: " << restarts << "\n";
+  std::cout << "elapsed: " << elapsed.count() << " s\n";
+  std::cout << "switches/sec: " << static_cast<long>(made / elapsed.count())
+            << "\n";
+}
@@ -0,0 +1,120 @@
+#include "dpor_trace.h"
+
+#include <gtest/gtest.h>
+
+#include <initializer_list>
+
+namespace {
+
+using ltest::AccessKind;
+using ltest::DporStep;
+using ltest::DporTrace;
+
+DporStep MakeStep(std::initializer_list<ltest::Access> accesses) {
+  DporStep step;
+  step.accesses.accesses = accesses;
+  step.accesses.is_reported = true;
+  return step;
+}
+
+DporStep Read(const void* address, size_t size = sizeof(int)) {
+  return MakeStep({{address, size, AccessKind::kRead}});
+}
+
+DporStep Write(const void* address, size_t size = sizeof(int)) {
+  return MakeStep({{address, size, AccessKind::kWrite}});
+}
+
+TEST(StepAccessesTest, RangesConflict) {
+  long long x[2]{};
+  auto write = Write(&x[0], sizeof(x[0]));
+  auto bytes = reinterpret_cast<const char*>(&x[0]);
+  EXPECT_TRUE(write.ConflictsWith(Read(bytes + 4)));
+  EXPECT_FALSE(write.ConflictsWith(Read(&x[1])));
+  EXPECT_FALSE(Read(&x[0], sizeof(x)).ConflictsWith(Read(&x[1])));
+  // The size of the access is unknown.
+  EXPECT_TRUE(Read(&x[1], 0).ConflictsWith(write));
+}
+
+TEST(StepAccessesTest, UnknownStepsConflict) {
+  int x{};
+  auto step = MakeStep({});
+  EXPECT_FALSE(step.ConflictsWith(Write(&x)));
+  step.accesses.is_unknown = true;
+  EXPECT_TRUE(step.ConflictsWith(MakeStep({})));
+  EXPECT_TRUE(DporStep{}.ConflictsWith(MakeStep({})));
+}
+
+TEST(DporTraceTest, ReversesRace) {
+  int x{}, y{};
+  DporTrace trace{2};
+  EXPECT_TRUE(trace.Push({true, true}));
+  EXPECT_EQ(trace.NextThread(), 0);
+  trace.Take(0, Write(&x));
+  EXPECT_TRUE(trace.Push({true, true}));
+  EXPECT_EQ(trace.NextThread(), 0);
+  trace.Take(0, Write(&y));
+  EXPECT_TRUE(trace.Push({false, true}));
+  EXPECT_EQ(trace.NextThread(), 1);
+  trace.Take(1, Read(&x));
+
+  EXPECT_TRUE(trace.HappensBefore(0, 2));
+  EXPECT_FALSE(trace.HappensBefore(1, 2));
+  EXPECT_EQ(trace[0].backtrack, (std::vector<bool>{true, true}));
+  EXPECT_EQ(trace[1].backtrack, (std::vector<bool>{true, false}));
+}
+
+TEST(DporTraceTest, NoRaceThroughHappensBefore) {
+  int x{}, y{};
+  DporTrace trace{3};
+  trace.Push({true, true, true});
+  EXPECT_EQ(trace.NextThread(), 0);
+  trace.Take(0, Write(&x));
+  trace.Push({false, true, true});
+  EXPECT_EQ(trace.NextThread(), 1);
+  auto step = Read(&x);
+  step.Merge(Write(&y));
+  trace.Take(1, step);
+  trace.Push({false, false, true});
+  EXPECT_EQ(trace.NextThread(), 2);
+  auto last = Read(&x);
+  last.Merge(Read(&y));
+  trace.Take(2, last);
+
+  // The write of x happens before the last step through the step of the
+  // thread 1, so only the thread 1 is raced with.
+  EXPECT_EQ(trace[0].backtrack, (std::vector<bool>{true, true, false}));
+  EXPECT_EQ(trace[1].backtrack, (std::vector<bool>{false, true, true}));
+}
+
+TEST(DporTraceTest, SleepSets) {
+  int x{}, y{};
+  DporTrace trace{2};
+  trace.Push({true, true});
+  EXPECT_EQ(trace.NextThread(), 0);
+  trace.Take(0, Write(&x));
+  trace.Push({false, true});
+  EXPECT_EQ(trace.NextThread(), 1);
+  trace.Take(1, Write(&x));
+  EXPECT_EQ(trace[0].backtrack, (std::vector<bool>{true, true}));
+  trace.Pop();
+
+  trace.Sleep(0, Write(&x));
+  EXPECT_EQ(trace.NextThread(), 1);
+  trace.Take(1, Write(&y));
+  // The thread 0 stays asleep, and there is nothing else to take.
+  EXPECT_FALSE(trace.Push({true, false}));
+  EXPECT_TRUE(trace.IsAsleep(1, 0));
+  trace.Pop();
+
+  EXPECT_TRUE(trace.Push({true, true}));
+  EXPECT_EQ(trace.NextThread(), 1);
+  trace.Take(1, Read(&x));
+  // The read conflicts with the write of the sleeping thread.
+  EXPECT_TRUE(trace.Push({true, false}));
+  EXPECT_FALSE(trace.IsAsleep(2, 0));
+  EXPECT_EQ(trace.NextThread(), 0);
+  EXPECT_EQ(trace.NextThread(), std::nullopt);
+}
+
+}  // namespace
@@ -0,0 +1,54 @@
+#include "fenwick_tree.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace {
+
+using ltest::FenwickTree;
+
+// Returns the index Find() must return, by the prefix sums.
+size_t FindLinear(const std::vector<long>& weights, long value) {
+  size_t i = 0;
+  for (; value >= weights[i]; ++i) {
+    value -= weights[i];
+  }
+  return i;
+}
+
+TEST(FenwickTreeTest, FindSkipsZeroWeights) {
+  FenwickTree tree;
+  tree.Reset(5);
+  tree.Set(1, 2);
+  tree.Set(4, 3);
+  EXPECT_EQ(tree.Total(), 5);
+  EXPECT_EQ(tree.Find(0), 1);
+  EXPECT_EQ(tree.Find(1), 1);
+  EXPECT_EQ(tree.Find(2), 4);
+  EXPECT_EQ(tree.Find(4), 4);
+
+  tree.Set(1, 0);
+  EXPECT_EQ(tree.Find(0), 4);
+}
+
+TEST(FenwickTreeTest, FindMatchesPrefixSums) {
+  // The sizes around the powers of two, where the steps of Find() start.
+  for (size_t size : {1, 2, 3, 7, 8, 9, 64, 65}) {
+    FenwickTree tree;
+    tree.Reset(size);
+    std::vector<long> weights(size);
+    for (size_t i = 0; i < size; ++i) {
+      weights[i] = i % 3;
+      tree.Set(i, weights[i]);
+    }
+    weights[size - 1] = 1;
+    tree.Set(size - 1, 1);
+    for (long value = 0; value < tree.Total(); ++value) {
+      EXPECT_EQ(tree.Find(value), FindLinear(weights, value))
+          << "size " << size << ", value " << value;
+    }
+  }
+}
+
+}  // namespace
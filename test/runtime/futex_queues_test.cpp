@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+
+#include "lib.h"
+
+namespace {
+
+// Task is never started, the queues use only its futex.
+struct Task final : CoroBase {
+  CoroBase* Restart(void*) override { return this; }
+  std::vector<std::string> GetStrArgs() const override { return {}; }
+  void* GetArgs() const override { return nullptr; }
+  bool HasEqualArgs(const CoroBase&) const override { return false; }
+};
+
+TEST(FutexQueuesTest, WaitChecksValue) {
+  auto& futexes = ltest::GetRuntimeContext().futexes;
+  int futex = 1;
+  Task task;
+  EXPECT_FALSE(futexes.Wait(&task, &futex, 0));
+  EXPECT_FALSE(task.IsBlocked());
+  EXPECT_TRUE(futexes.Wait(&task, &futex, 1));
+  EXPECT_TRUE(task.IsBlocked());
+  // The changed value doesn't wake anyone.
+  futex = 0;
+  EXPECT_TRUE(task.IsBlocked());
+  EXPECT_EQ(futexes.Wake(&futex, 1), 1);
+  EXPECT_FALSE(task.IsBlocked());
+}
+
+TEST(FutexQueuesTest, WakeCounts) {
+  auto& futexes = ltest::GetRuntimeContext().futexes;
+  int futex{}, other{};
+  Task tasks[3];
+  for (auto& task : tasks) {
+    ASSERT_TRUE(futexes.Wait(&task, &futex, 0));
+  }
+  EXPECT_EQ(futexes.Wake(&other, 1), 0);
+  // The tasks are woken in the order they wait.
+  EXPECT_EQ(futexes.Wake(&futex, 2), 2);
+  EXPECT_FALSE(tasks[0].IsBlocked());
+  EXPECT_FALSE(tasks[1].IsBlocked());
+  EXPECT_TRUE(tasks[2].IsBlocked());
+  EXPECT_EQ(futexes.Wake(&futex, 2), 1);
+  EXPECT_EQ(futexes.Wake(&futex, 2), 0);
+}
+
+TEST(FutexQueuesTest, Remove) {
+  auto& futexes = ltest::GetRuntimeContext().futexes;
+  int futex{};
+  Task tasks[3];
+  for (auto& task : tasks) {
+    ASSERT_TRUE(futexes.Wait(&task, &futex, 0));
+  }
+  futexes.Remove(&tasks[1]);
+  EXPECT_FALSE(tasks[1].IsBlocked());
+  EXPECT_EQ(futexes.Wake(&futex, 1), 1);
+  EXPECT_FALSE(tasks[0].IsBlocked());
+  EXPECT_TRUE(tasks[2].IsBlocked());
+  // The destroyed task leaves the queue.
+  {
+    Task task;
+    ASSERT_TRUE(futexes.Wait(&task, &futex, 0));
+  }
+  EXPECT_EQ(futexes.Wake(&futex, 2), 1);
+  EXPECT_FALSE(tasks[2].IsBlocked());
+}
+
+}  // namespace
@@ -26,12 +26,15 @@ struct std::equal_to<Counter> {
   }
 };
 
-std::shared_ptr<CoroBase> CreateMockTask(std::string name, int ret_val,
-                                         void* args) {
-  auto mock = std::make_shared<MockTask>();
+Task CreateMockTask(ltest::TaskArena& arena, std::string name, int ret_val,
+                    void* args) {
+  auto mock = arena.New<MockTask>();
   EXPECT_CALL(*mock, GetRetVal())
       .Times(testing::AnyNumber())
       .WillRepeatedly(testing::Return(ret_val));
+  EXPECT_CALL(*mock, GetMethodId())
+      .Times(testing::AnyNumber())
+      .WillRepeatedly(testing::Return(ltest::GetMethodId(name)));
   EXPECT_CALL(*mock, GetName())
       .Times(testing::AnyNumber())
       .WillRepeatedly(testing::Return(std::move(name)));
@@ -39,7 +42,7 @@ std::shared_ptr<CoroBase> CreateMockTask(std::string name, int ret_val,
       .Times(testing::AnyNumber())
       .WillRepeatedly(testing::Return(args));
 
-  return static_pointer_cast<CoroBase>(mock);
+  return mock;
 }
 
 namespace LinearizabilityCheckerTest {
@@ -70,11 +73,12 @@ TEST(LinearizabilityCheckerCounterTest, SmallLinearizableHistory) {
   auto empty_args_unique = std::make_unique<std::tuple<>>(std::tuple<>{});
   void* empty_args = reinterpret_cast<void*>(empty_args_unique.get());
 
-  Task first_task = CreateMockTask("faa", 3, empty_args);
-  Task second_task = CreateMockTask("get", 3, empty_args);
-  Task third_task = CreateMockTask("faa", 2, empty_args);
-  Task fourth_task = CreateMockTask("faa", 1, empty_args);
-  Task fifth_task = CreateMockTask("faa", 0, empty_args);
+  ltest::TaskArena arena;
+  Task first_task = CreateMockTask(arena, "faa", 3, empty_args);
+  Task second_task = CreateMockTask(arena, "get", 3, empty_args);
+  Task third_task = CreateMockTask(arena, "faa", 2, empty_args);
+  Task fourth_task = CreateMockTask(arena, "faa", 1, empty_args);
+  Task fifth_task = CreateMockTask(arena, "faa", 0, empty_args);
 
   std::vector<HistoryEvent> history{};
   history.emplace_back(Invoke(first_task, 0));
@@ -106,11 +110,12 @@ TEST(LinearizabilityCheckerCounterTest, SmallUnlinearizableHistory) {
   auto empty_args_unique = std::make_unique<std::tuple<>>(std::tuple<>{});
   void* empty_args = reinterpret_cast<void*>(empty_args_unique.get());
 
-  Task first_task = CreateMockTask("faa", 2, empty_args);
-  Task second_task = CreateMockTask("get", 3, empty_args);
-  Task third_task = CreateMockTask("faa", 100, empty_args);
-  Task fourth_task = CreateMockTask("faa", 1, empty_args);
-  Task fifth_task = CreateMockTask("faa", 0, empty_args);
+  ltest::TaskArena arena;
+  Task first_task = CreateMockTask(arena, "faa", 2, empty_args);
+  Task second_task = CreateMockTask(arena, "get", 3, empty_args);
+  Task third_task = CreateMockTask(arena, "faa", 100, empty_args);
+  Task fourth_task = CreateMockTask(arena, "faa", 1, empty_args);
+  Task fifth_task = CreateMockTask(arena, "faa", 0, empty_args);
 
   std::vector<HistoryEvent> history{};
   history.emplace_back(Invoke(first_task, 0));
@@ -142,11 +147,12 @@ TEST(LinearizabilityCheckerCounterTest, ExtendedLinearizableHistory) {
   auto empty_args_unique = std::make_unique<std::tuple<>>(std::tuple<>{});
   void* empty_args = reinterpret_cast<void*>(empty_args_unique.get());
 
-  Task first_task = CreateMockTask("faa", 2, empty_args);
-  Task second_task = CreateMockTask("get", 3, empty_args);
-  Task third_task = CreateMockTask("faa", 100, empty_args);
-  Task fourth_task = CreateMockTask("faa", 1, empty_args);
-  Task fifth_task = CreateMockTask("faa", 0, empty_args);
+  ltest::TaskArena arena;
+  Task first_task = CreateMockTask(arena, "faa", 2, empty_args);
+  Task second_task = CreateMockTask(arena, "get", 3, empty_args);
+  Task third_task = CreateMockTask(arena, "faa", 100, empty_args);
+  Task fourth_task = CreateMockTask(arena, "faa", 1, empty_args);
+  Task fifth_task = CreateMockTask(arena, "faa", 0, empty_args);
 
   std::vector<HistoryEvent> history{};
   history.emplace_back(Invoke(first_task, 0));
@@ -158,7 +164,8 @@ TEST(LinearizabilityCheckerCounterTest, ExtendedLinearizableHistory) {
   EXPECT_EQ(checker.Check(history), true);
 }
 
-std::vector<Task> create_mocks(const std::vector<bool>& b_history) {
+std::vector<Task> create_mocks(ltest::TaskArena& arena,
+                               const std::vector<bool>& b_history) {
   std::vector<Task> mocks;
   mocks.reserve(b_history.size());
   size_t adds = 0;
@@ -169,10 +176,10 @@ std::vector<Task> create_mocks(const std::vector<bool>& b_history) {
 
   for (auto v : b_history) {
     if (v) {
-      mocks.emplace_back(CreateMockTask("faa", adds, empty_args));
+      mocks.emplace_back(CreateMockTask(arena, "faa", adds, empty_args));
       adds++;
     } else {
-      mocks.emplace_back(CreateMockTask("get", adds, empty_args));
+      mocks.emplace_back(CreateMockTask(arena, "get", adds, empty_args));
     }
   }
 
@@ -260,7 +267,8 @@ void CheckersAreTheSame(const std::vector<bool>& b_history) {
       },
       c);
 
-  auto mocks = create_mocks(b_history);
+  ltest::TaskArena arena;
+  auto mocks = create_mocks(arena, b_history);
   auto history = create_history(mocks);
   EXPECT_EQ(fast.Check(history), slow.Check(history)) << draw_history(history);
 }
@@ -0,0 +1,100 @@
+#include "round_heap.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <tuple>
+
+#include "lib.h"
+
+namespace {
+
+using ltest::RoundHeap;
+
+TEST(RoundHeapTest, RewindReusesMemory) {
+  RoundHeap heap{4096};
+  auto first = heap.Allocate(24, 8);
+  auto second = heap.Allocate(8, 64);
+  ASSERT_NE(first, nullptr);
+  ASSERT_NE(second, nullptr);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(second) % 64, 0);
+  EXPECT_GE(static_cast<char*>(second), static_cast<char*>(first) + 24);
+
+  heap.Rewind();
+  EXPECT_EQ(heap.Allocate(24, 8), first);
+}
+
+TEST(RoundHeapTest, FullHeap) {
+  RoundHeap heap{4096};
+  EXPECT_NE(heap.Allocate(4000, 8), nullptr);
+  EXPECT_EQ(heap.Allocate(100, 8), nullptr);
+  // The failed allocation takes nothing.
+  EXPECT_NE(heap.Allocate(96, 8), nullptr);
+  heap.Rewind();
+  EXPECT_NE(heap.Allocate(4096, 8), nullptr);
+}
+
+TEST(RoundHeapTest, Owns) {
+  RoundHeap heap{4096};
+  auto begin = static_cast<char*>(heap.Allocate(4096, 1));
+  EXPECT_TRUE(heap.Owns(begin));
+  EXPECT_TRUE(heap.Owns(begin + 4095));
+  EXPECT_FALSE(heap.Owns(begin + 4096));
+  EXPECT_FALSE(heap.Owns(begin - 1));
+  int local{};
+  EXPECT_FALSE(heap.Owns(&local));
+}
+
+// Calls operator new directly, the compiler may elide new expressions.
+TEST(RoundHeapTest, NewGoesToActiveHeap) {
+  RoundHeap heap{4096};
+  ltest::RoundHeapGuard guard{&heap};
+  auto outside = ::operator new(sizeof(int));
+  EXPECT_FALSE(heap.Owns(outside));
+  {
+    ltest::RoundHeapScope scope{true};
+    auto inside = ::operator new(sizeof(int));
+    EXPECT_TRUE(heap.Owns(inside));
+    ::operator delete(inside);
+    {
+      ltest::RoundHeapScope nested{false};
+      auto excluded = ::operator new(sizeof(int));
+      EXPECT_FALSE(heap.Owns(excluded));
+      ::operator delete(excluded);
+    }
+    // Falls back to malloc when the heap is full.
+    auto big = ::operator new[](8192);
+    EXPECT_FALSE(heap.Owns(big));
+    ::operator delete[](big);
+  }
+  EXPECT_FALSE(heap.active);
+  ::operator delete(outside);
+}
+
+struct Target {};
+
+ValueWrapper ReturnString(Target*) {
+  return ValueWrapper{std::string(100, 'x'),
+                      GetDefaultCompator<std::string>(),
+                      [](const ValueWrapper& value) {
+                        return value.GetValue<std::string>();
+                      }};
+}
+
+// The string doesn't fit into the wrapper, so it's allocated by the task.
+TEST(RoundHeapTest, ResultOutlivesRewind) {
+  RoundHeap heap{1 << 20};
+  ltest::RoundHeapGuard guard{&heap};
+  Target target;
+  Coro<Target> task{&ReturnString, &target, {}, nullptr, 0, 0};
+  task.Resume();
+  ASSERT_TRUE(task.IsReturned());
+
+  heap.Rewind();
+  std::memset(heap.Allocate(4096, 1), 0, 4096);
+  EXPECT_EQ(task.GetRetVal().GetValue<std::string>(), std::string(100, 'x'));
+}
+
+}  // namespace
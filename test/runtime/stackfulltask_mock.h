@@ -13,8 +13,10 @@ class MockTask : public CoroBase {
   MOCK_METHOD(bool, IsReturned, (), (const));
   MOCK_METHOD(ValueWrapper, GetRetVal, (), (const, override));
   MOCK_METHOD(std::string_view, GetName, (), (const, override));
+  MOCK_METHOD(ltest::MethodId, GetMethodId, (), (const, override));
   MOCK_METHOD(std::vector<std::string>, GetStrArgs, (), (const, override));
   MOCK_METHOD(void*, GetArgs, (), (const, override));
+  MOCK_METHOD(bool, HasEqualArgs, (const CoroBase&), (const, override));
   MOCK_METHOD(bool, IsSuspended, (), (const));
   MOCK_METHOD(void, Terminate, (), ());
   MOCK_METHOD(void, SetToken, (std::shared_ptr<Token>), ());
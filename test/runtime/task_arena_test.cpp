@@ -0,0 +1,43 @@
+#include "task_arena.h"
+
+#include <gtest/gtest.h>
+
+#include "lib.h"
+
+namespace {
+
+struct Target {
+  bool is_unwound{};
+};
+
+// Yields in the destructor, like a lock guard of the target does.
+struct YieldOnExit {
+  ~YieldOnExit() {
+    CoroYield();
+    target->is_unwound = true;
+  }
+
+  Target* target;
+};
+
+ValueWrapper Suspend(Target* target) {
+  YieldOnExit guard{target};
+  CoroYield();
+  return void_v;
+}
+
+TEST(TaskArenaTest, RewindSuspendedTask) {
+  ltest::TaskArena arena;
+  Target target;
+  auto task = arena.New<Coro<Target>>(&Suspend, &target, std::tuple<>{},
+                                      nullptr, 0, 0);
+  task->Resume();
+  ASSERT_FALSE(task->IsReturned());
+
+  arena.Clear();
+#if !defined(LTEST_CONTEXT_ASM) && !defined(LTEST_CONTEXT_UCONTEXT)
+  EXPECT_TRUE(target.is_unwound);
+#endif
+}
+
+}  // namespace
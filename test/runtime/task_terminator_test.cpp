@@ -0,0 +1,130 @@
+#include "task_terminator.h"
+
+#include <gtest/gtest.h>
+
+#include <deque>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <vector>
+
+#include "lib.h"
+
+namespace {
+
+// Two locks with the queues of the tasks, the first task holds the lock.
+struct Locks {
+  std::deque<Token*> queues[2];
+  // Are set by the reset of the terminator.
+  bool released{};
+  bool stopped{};
+  size_t spins{};
+
+  void Lock(int lock, Token* token) {
+    auto& queue = queues[lock];
+    queue.push_back(token);
+    if (queue.size() > 1) {
+      token->Park(*queue[queue.size() - 2]);
+    }
+  }
+
+  void Unlock(int lock) {
+    auto& queue = queues[lock];
+    if (released) {
+      return;
+    }
+    queue.pop_front();
+    if (!queue.empty()) {
+      queue.front()->Unpark();
+    }
+  }
+};
+
+ValueWrapper LockBoth(Locks* locks, std::shared_ptr<Token> token, int first) {
+  locks->Lock(first, token.get());
+  CoroYield();
+  locks->Lock(1 - first, token.get());
+  locks->Unlock(1 - first);
+  locks->Unlock(first);
+  return void_v;
+}
+
+ValueWrapper Spin(Locks* locks) {
+  while (!locks->stopped) {
+    ++locks->spins;
+    CoroYield();
+  }
+  return void_v;
+}
+
+using LockTask = Coro<Locks, std::shared_ptr<Token>, int>;
+
+struct TaskTerminatorTest : testing::Test {
+  Locks locks;
+  std::shared_ptr<Token> tokens[2]{std::make_shared<Token>(),
+                                   std::make_shared<Token>()};
+  ltest::MethodId lock_both = ltest::GetMethodId("LockBoth");
+  std::optional<LockTask> first;
+  std::optional<LockTask> second;
+  Coro<Locks> spinner{&Spin, &locks, {}, nullptr, ltest::GetMethodId("Spin"),
+                      2};
+  ltest::TaskTerminator terminator;
+  size_t resets{};
+
+  // The tasks take the locks starting from the given ones.
+  void MakeTasks(int first_lock, int second_lock) {
+    first.emplace(&LockBoth, &locks, std::tuple{tokens[0], first_lock},
+                  nullptr, lock_both, 0);
+    first->SetToken(tokens[0]);
+    second.emplace(&LockBoth, &locks, std::tuple{tokens[1], second_lock},
+                   nullptr, lock_both, 1);
+    second->SetToken(tokens[1]);
+  }
+
+  size_t Terminate() {
+    terminator.AddThread(std::vector<Task>{&*first});
+    terminator.AddThread(std::vector<Task>{&*second});
+    terminator.AddThread(std::vector<Task>{&spinner});
+    return terminator.Terminate([this] {
+      locks.queues[0].clear();
+      locks.queues[1].clear();
+      locks.released = true;
+      locks.stopped = true;
+      ++resets;
+    });
+  }
+};
+
+TEST_F(TaskTerminatorTest, WaiterAfterHolder) {
+  MakeTasks(0, 0);
+  second->Resume();
+  first->Resume();
+  ASSERT_TRUE(first->IsParked());
+  EXPECT_EQ(first->GetToken()->GetHolder(), tokens[1].get());
+  locks.stopped = true;
+
+  EXPECT_EQ(Terminate(), 0);
+  EXPECT_EQ(resets, 0);
+  EXPECT_TRUE(first->IsReturned());
+  EXPECT_TRUE(second->IsReturned());
+}
+
+// The cycle is found while the spinner still runs.
+TEST_F(TaskTerminatorTest, Cycle) {
+  MakeTasks(0, 1);
+  first->Resume();
+  second->Resume();
+  first->Resume();
+  second->Resume();
+  ASSERT_TRUE(first->IsParked());
+  ASSERT_TRUE(second->IsParked());
+
+  EXPECT_EQ(Terminate(), 0);
+  EXPECT_EQ(resets, 1);
+  EXPECT_EQ(locks.spins, 0);
+  EXPECT_TRUE(first->IsReturned());
+  EXPECT_TRUE(second->IsReturned());
+  EXPECT_TRUE(spinner.IsReturned());
+}
+
+}  // namespace
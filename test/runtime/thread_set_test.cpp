@@ -0,0 +1,63 @@
+#include "thread_set.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace {
+
+using ltest::ThreadSet;
+
+ThreadSet MakeSet(size_t threads_count, std::vector<size_t> threads) {
+  ThreadSet set;
+  set.Reset(threads_count);
+  for (auto thread : threads) {
+    EXPECT_TRUE(set.Insert(thread));
+  }
+  return set;
+}
+
+TEST(ThreadSetTest, NextCyclicAtWordBoundaries) {
+  auto set = MakeSet(130, {0, 63, 64, 129});
+  EXPECT_EQ(set.NextCyclic(0), 0);
+  EXPECT_EQ(set.NextCyclic(1), 63);
+  EXPECT_EQ(set.NextCyclic(63), 63);
+  EXPECT_EQ(set.NextCyclic(64), 64);
+  EXPECT_EQ(set.NextCyclic(65), 129);
+  EXPECT_EQ(set.NextCyclic(128), 129);
+
+  // Wraps around through the empty words.
+  set.Erase(0);
+  set.Erase(129);
+  EXPECT_EQ(set.NextCyclic(65), 63);
+  set.Erase(63);
+  EXPECT_EQ(set.NextCyclic(65), 64);
+  EXPECT_EQ(set.NextCyclic(64), 64);
+}
+
+TEST(ThreadSetTest, SelectAtWordBoundaries) {
+  auto set = MakeSet(192, {63, 64, 127, 128, 191});
+  std::vector<size_t> selected;
+  for (size_t k = 0; k < set.Size(); ++k) {
+    selected.push_back(set.Select(k));
+  }
+  EXPECT_EQ(selected, (std::vector<size_t>{63, 64, 127, 128, 191}));
+
+  // The whole word.
+  set = MakeSet(128, {});
+  for (size_t i = 64; i < 128; ++i) {
+    set.Insert(i);
+  }
+  EXPECT_EQ(set.Select(0), 64);
+  EXPECT_EQ(set.Select(63), 127);
+}
+
+TEST(ThreadSetTest, InsertAndErase) {
+  auto set = MakeSet(64, {3});
+  EXPECT_FALSE(set.Insert(3));
+  EXPECT_TRUE(set.Erase(3));
+  EXPECT_FALSE(set.Erase(3));
+  EXPECT_TRUE(set.Empty());
+}
+
+}  // namespace
@@ -0,0 +1,65 @@
+#include "visited_states.h"
+
+#include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+using ltest::VisitedStates;
+
+TEST(VisitedStatesTest, ExactSwitchRule) {
+  VisitedStates states{VisitedStates::Mode::kExact, 16};
+  EXPECT_FALSE(states.Visit(42, 2, 0));
+  // The same thread continues without a switch.
+  EXPECT_TRUE(states.Visit(42, 2, 0));
+  EXPECT_TRUE(states.Visit(42, 3, 0));
+  // Another thread may need one more switch to continue.
+  EXPECT_FALSE(states.Visit(42, 2, 1));
+  EXPECT_TRUE(states.Visit(42, 3, 1));
+  // Fewer switches leave more to explore, the entry is updated.
+  EXPECT_FALSE(states.Visit(42, 1, 1));
+  EXPECT_TRUE(states.Visit(42, 1, 1));
+  EXPECT_FALSE(states.Visit(42, 1, 0));
+  EXPECT_EQ(states.GetVisits(), 8);
+  EXPECT_EQ(states.GetPruned(), 4);
+}
+
+TEST(VisitedStatesTest, FullExactTable) {
+  VisitedStates states{VisitedStates::Mode::kExact, 8};
+  // Half of the table is filled.
+  for (uint64_t fingerprint = 1; fingerprint <= 4; ++fingerprint) {
+    EXPECT_FALSE(states.Visit(fingerprint, 0, 0));
+  }
+  EXPECT_FALSE(states.Visit(5, 0, 0));
+  EXPECT_FALSE(states.Visit(5, 0, 0));
+  for (uint64_t fingerprint = 1; fingerprint <= 4; ++fingerprint) {
+    EXPECT_TRUE(states.Visit(fingerprint, 0, 0));
+  }
+  // The probe of a fingerprint that collides with the stored ones.
+  EXPECT_FALSE(states.Visit(9, 0, 0));
+}
+
+TEST(VisitedStatesTest, Approximate) {
+  VisitedStates states{VisitedStates::Mode::kApproximate, 1 << 16};
+  EXPECT_FALSE(states.Visit(42, 2, 0));
+  EXPECT_TRUE(states.Visit(42, 2, 0));
+  EXPECT_FALSE(states.Visit(42, 3, 0));
+  EXPECT_FALSE(states.Visit(42, 2, 1));
+}
+
+TEST(VisitedStatesTest, SharedWithForkedChildren) {
+  VisitedStates states{VisitedStates::Mode::kExact, 16};
+  auto pid = ::fork();
+  ASSERT_GE(pid, 0);
+  if (pid == 0) {
+    states.Visit(42, 0, 0);
+    ::_exit(0);
+  }
+  int status{};
+  ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+  EXPECT_TRUE(states.Visit(42, 0, 0));
+  EXPECT_EQ(states.GetVisits(), 2);
+}
+
+}  // namespace
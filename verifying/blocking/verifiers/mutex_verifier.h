@@ -4,18 +4,18 @@
 
 struct MutexVerifier {
   bool Verify(CreatedTaskMetaData ctask) {
-    auto [taskName, is_new, thread_id] = ctask;
-    debug(stderr, "validating method %s, thread_id: %zu\n", taskName.data(),
-          thread_id);
+    auto [method_id, is_new, thread_id] = ctask;
+    debug(stderr, "validating method %s, thread_id: %zu\n",
+          ltest::GetMethodName(method_id).data(), thread_id);
     if (!is_new) {
       return true;
     }
     if (status.count(thread_id) == 0) {
       status[thread_id] = 0;
     }
-    if (taskName == "Lock") {
+    if (method_id == lock) {
       return status[thread_id] == 0;
-    } else if (taskName == "Unlock") {
+    } else if (method_id == unlock) {
       return status[thread_id] == 1;
     } else {
       assert(false);
@@ -24,12 +24,12 @@ struct MutexVerifier {
 
   void OnFinished(TaskWithMetaData ctask) {
     auto [task, is_new, thread_id] = ctask;
-    auto taskName = task->GetName();
-    debug(stderr, "On finished method %s, thread_id: %zu\n", taskName.data(),
-          thread_id);
-    if (taskName == "Lock") {
+    auto method_id = task->GetMethodId();
+    debug(stderr, "On finished method %s, thread_id: %zu\n",
+          ltest::GetMethodName(method_id).data(), thread_id);
+    if (method_id == lock) {
       status[thread_id] = 1;
-    } else if (taskName == "Unlock") {
+    } else if (method_id == unlock) {
       status[thread_id] = 0;
     }
   }
@@ -41,4 +41,7 @@ struct MutexVerifier {
   // NOTE(kmitkin): we cannot just store number of thread that holds mutex
   //                because Lock can finish before Unlock!
   std::unordered_map<size_t, size_t> status;
+
+  ltest::MethodId lock = ltest::GetMethodId("Lock");
+  ltest::MethodId unlock = ltest::GetMethodId("Unlock");
 };
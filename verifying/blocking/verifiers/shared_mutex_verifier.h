@@ -6,21 +6,21 @@ struct SharedMutexVerifier {
   enum : int32_t { READER = 4, WRITER = 1, FREE = 0 };
   /// Verify checks the state of a mutex on starting of `ctask`
   bool Verify(CreatedTaskMetaData ctask) {
-    auto [taskName, is_new, thread_id] = ctask;
-    debug(stderr, "validating method %s, thread_id: %zu\n", taskName.data(),
-          thread_id);
+    auto [method_id, is_new, thread_id] = ctask;
+    debug(stderr, "validating method %s, thread_id: %zu\n",
+          ltest::GetMethodName(method_id).data(), thread_id);
     if (status.count(thread_id) == 0) {
       status[thread_id] = FREE;
     }
     /// When `lock` is executed, it is expected that current thread doesn't hold
     /// a mutex because otherwise we get recursive lock and UB
-    if (taskName == "lock") {
+    if (method_id == lock) {
       return status[thread_id] == FREE;
-    } else if (taskName == "unlock") {
+    } else if (method_id == unlock) {
       return status[thread_id] == WRITER;
-    } else if (taskName == "lock_shared") {
+    } else if (method_id == lock_shared) {
       return status[thread_id] == FREE;
-    } else if (taskName == "unlock_shared") {
+    } else if (method_id == unlock_shared) {
       return status[thread_id] == READER;
     } else {
       assert(false);
@@ -29,16 +29,16 @@ struct SharedMutexVerifier {
 
   void OnFinished(TaskWithMetaData ctask) {
     auto [task, is_new, thread_id] = ctask;
-    auto taskName = task->GetName();
-    debug(stderr, "On finished method %s, thread_id: %zu\n", taskName.data(),
-          thread_id);
-    if (taskName == "lock") {
+    auto method_id = task->GetMethodId();
+    debug(stderr, "On finished method %s, thread_id: %zu\n",
+          ltest::GetMethodName(method_id).data(), thread_id);
+    if (method_id == lock) {
       status[thread_id] = WRITER;
-    } else if (taskName == "unlock") {
+    } else if (method_id == unlock) {
       status[thread_id] = FREE;
-    } else if (taskName == "lock_shared") {
+    } else if (method_id == lock_shared) {
       status[thread_id] = READER;
-    } else if (taskName == "unlock_shared") {
+    } else if (method_id == unlock_shared) {
       status[thread_id] = FREE;
     } else {
       assert(false);
@@ -50,4 +50,9 @@ struct SharedMutexVerifier {
   void UpdateState(std::string_view, int, bool) {}
 
   std::unordered_map<size_t, size_t> status;
+
+  ltest::MethodId lock = ltest::GetMethodId("lock");
+  ltest::MethodId unlock = ltest::GetMethodId("unlock");
+  ltest::MethodId lock_shared = ltest::GetMethodId("lock_shared");
+  ltest::MethodId unlock_shared = ltest::GetMethodId("unlock_shared");
 };
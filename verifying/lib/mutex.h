@@ -22,7 +22,8 @@ struct Mutex {
     if (waiters.size() == 1) {
       return;
     }
-    token->Park();
+    // The task before in the queue unparks this one when it unlocks.
+    token->Park(*waiters[waiters.size() - 2]);
   }
 
   // Assume this method is atomic.
@@ -33,8 +33,7 @@ struct Queue {
   }
   static auto GetMethods() {
     mutex_method_t push_func = [](Queue *l, void *args) -> int {
-      auto real_args = reinterpret_cast<std::tuple<int> *>(args);
-      return l->Push(std::get<0>(*real_args));
+      return l->Push(ltest::GetArg<0, std::tuple<int>>(args));
     };
 
     mutex_method_t pop_func = [](Queue *l, void *args) -> int {
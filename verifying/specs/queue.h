@@ -24,8 +24,7 @@ struct Queue {
   using method_t = std::function<ValueWrapper(Queue *l, void *args)>;
   static auto GetMethods() {
     method_t push_func = [](Queue *l, void *args) -> ValueWrapper {
-      auto real_args = reinterpret_cast<PushArgTuple *>(args);
-      l->Push(std::get<ValueIndex>(*real_args));
+      l->Push(ltest::GetArg<ValueIndex, PushArgTuple>(args));
       return void_v;
     };
 
@@ -20,13 +20,11 @@ struct Set {
   using method_t = std::function<ValueWrapper(Set *l, void *args)>;
   static auto GetMethods() {
     method_t insert_func = [](Set *l, void *args) -> int {
-      auto real_args = reinterpret_cast<ArgTuple *>(args);
-      return l->Insert(std::get<ValueIndex>(*real_args));
+      return l->Insert(ltest::GetArg<ValueIndex, ArgTuple>(args));
     };
 
     method_t erase_func = [](Set *l, void *args) -> int {
-      auto real_args = reinterpret_cast<ArgTuple *>(args);
-      return l->Erase(std::get<ValueIndex>(*real_args));
+      return l->Erase(ltest::GetArg<ValueIndex, ArgTuple>(args));
     };
 
     return std::map<std::string, method_t>{
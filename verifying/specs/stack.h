@@ -22,8 +22,7 @@ struct Stack {
   using method_t = std::function<ValueWrapper(Stack *l, void *args)>;
   static auto GetMethods() {
     method_t push_func = [](Stack *l, void *args) -> ValueWrapper {
-      auto real_args = reinterpret_cast<PushArgTuple *>(args);
-      l->Push(std::get<ValueIndex>(*real_args));
+      l->Push(ltest::GetArg<ValueIndex, PushArgTuple>(args));
       return void_v;
     };
 
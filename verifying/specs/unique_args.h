@@ -27,8 +27,7 @@ struct UniqueArgsRef {
   using MethodT = std::function<ValueWrapper(UniqueArgsRef *l, void *args)>;
   static auto GetMethods() {
     MethodT get = [](UniqueArgsRef *l, void *args) {
-      auto real_args = reinterpret_cast<std::tuple<size_t> *>(args);
-      return l->Get(std::get<0>(*real_args));
+      return l->Get(ltest::GetArg<0, std::tuple<size_t>>(args));
     };
 
     return std::map<std::string, MethodT>{
@@ -12,6 +12,8 @@ struct Register {
 
   void Reset() { x.store(0); }
 
+  size_t StateHash() const { return x.load(); }
+
   std::atomic<int> x{};
 };
 
@@ -57,7 +57,7 @@ auto generateInt(size_t thread_num) {
 }
 
 auto generateArgs(size_t thread_num) {
-  auto token = ltest::generators::genToken(thread_num);
+  auto token = ltest::generators::genToken();
   auto _int = generateInt(thread_num);
   return std::tuple_cat(token, _int);
 }
@@ -26,8 +26,9 @@ struct Node {
 
 const int size = 2;
 
-auto generateInt(size_t thread_num) {
-  return ltest::generators::makeSingleArg(rand() % 10 + 1);
+auto generateInt() {
+  return ltest::generators::makeSingleArg(
+      ltest::generators::randomInt(1, 10));
 }
 
 class MPMCBoundedQueue {
@@ -47,6 +48,20 @@ class MPMCBoundedQueue {
     tail_.store(0);
   }
 
+  // Hashes the positions, the generations and the values in the queue.
+  size_t StateHash() const {
+    size_t head = head_.load();
+    size_t tail = tail_.load();
+    size_t hash = head * 31 + tail;
+    for (auto &node : vec_) {
+      hash = hash * 31 + node.generation.load();
+    }
+    for (size_t i = tail; i < head; ++i) {
+      hash = hash * 31 + vec_[i & max_size_].val;
+    }
+    return hash;
+  }
+
   non_atomic int Push(int value) {
     while (true) {
       auto h = head_.load(/*std::memory_order_relaxed*/);
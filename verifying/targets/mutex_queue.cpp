@@ -47,10 +47,13 @@ struct Queue {
 
 namespace ltest {}  // namespace ltest
 
-auto generateInt() { return ltest::generators::makeSingleArg(rand() % 10 + 1); }
+auto generateInt() {
+  return ltest::generators::makeSingleArg(
+      ltest::generators::randomInt(1, 10));
+}
 
-auto generateArgs(size_t thread_num) {
-  auto token = ltest::generators::genToken(thread_num);
+auto generateArgs() {
+  auto token = ltest::generators::genToken();
   auto _int = generateInt();
   return std::tuple_cat(token, _int);
 }
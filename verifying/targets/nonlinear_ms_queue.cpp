@@ -121,8 +121,9 @@ struct MSQueue {
 };
 
 // Arguments generator.
-auto generateInt(size_t unused) {
-  return ltest::generators::makeSingleArg(rand() % 10 + 1);
+auto generateInt() {
+  return ltest::generators::makeSingleArg(
+      ltest::generators::randomInt(1, 10));
 }
 
 // Specify target structure and it's sequential specification.
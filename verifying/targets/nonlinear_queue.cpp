@@ -39,8 +39,9 @@ struct Queue {
 };
 
 // Arguments generator.
-auto generateInt(size_t unused_param) {
-  return ltest::generators::makeSingleArg(rand() % 10 + 1);
+auto generateInt() {
+  return ltest::generators::makeSingleArg(
+      ltest::generators::randomInt(1, 10));
 }
 
 // Specify target structure and it's sequential specification.
@@ -57,7 +57,7 @@ struct SlotsSet {
 };
 
 // Arguments generator.
-auto generateInt(size_t unused_param) {
+auto generateInt() {
   // single value in arguments, because to find nonlinearizable
   // scenario we need 4 operations with the same argument
   // (which is pretty hard to find)
@@ -73,8 +73,9 @@ struct TreiberStack {
 };
 
 // Arguments generator.
-auto generateInt(size_t thread_num) {
-  return ltest::generators::makeSingleArg(rand() % 10 + 1);
+auto generateInt() {
+  return ltest::generators::makeSingleArg(
+      ltest::generators::randomInt(1, 10));
 }
 
 // Specify target structure and it's sequential specification.